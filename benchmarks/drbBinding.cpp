@@ -0,0 +1,267 @@
+/*
+    Measures whether the DRB is read faster as a uniform buffer or as a
+    storage buffer, for DRBs of different sizes. It runs headless on
+    the Mesa driver of the system through EGL, without the game.
+
+    Every object reads the 3 words of a translation state at a random
+    location of the DRB and decodes it, like getGroupCombinationState()
+    in shared.h. This is done once per object in a compute shader (the
+    resolve pass) and once per vertex in a vertex shader with transform
+    feedback (object.vert without the resolve pass).
+
+    Build: g++ -O2 -std=c++20 benchmarks/drbBinding.cpp -o drbBinding -lEGL -lGL
+    Run:   ./drbBinding [object count]
+
+    The crossover is the smallest DRB size at which the storage buffer
+    is faster in both passes by more than the noise margin. The largest
+    size the renderer binds as a uniform buffer, DRB_MAX_UNIFORM_BUFFER_SIZE
+    in shared.h, is kept below it.
+*/
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using u32 = uint32_t;
+
+static constexpr u32 GROUP_SIZE = 64;
+static constexpr u32 ITERATIONS = 20;
+static constexpr u32 RUNS       = 9;
+// Differences below this are run to run noise on llvmpipe
+static constexpr double NOISE_MARGIN = 0.05;
+
+static const char* DRB_DECLARATIONS = R"(
+#ifdef DRB_UNIFORM_BUFFER
+layout (std140, binding = 0) uniform DRB { uvec4 groupStates[DRB_SIZE / 16]; } drb;
+#else
+layout (std430, binding = 0) readonly buffer DRB { uvec4 groupStates[]; } drb;
+#endif
+layout (std430, binding = 1) readonly buffer Locations { uint locations[]; };
+
+#define DRB_WORD(I) drb.groupStates[(I) >> 2][(I) & 3u]
+
+vec3 readState(uint location) {
+    vec2  offset  = uintBitsToFloat(uvec2(DRB_WORD(location), DRB_WORD(location + 1u)));
+    float opacity = unpackHalf2x16(DRB_WORD(location + 2u)).x;
+    return vec3(offset, opacity);
+}
+)";
+
+static const char* COMPUTE_SOURCE = R"(
+layout (local_size_x = 64) in;
+layout (std430, binding = 2) writeonly buffer Results { vec4 results[]; };
+uniform uint u_objectCount;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= u_objectCount)
+        return;
+    results[index] = vec4(readState(locations[index]), 1.0);
+}
+)";
+
+static const char* VERTEX_SOURCE = R"(
+out vec4 v_result;
+
+void main() {
+    v_result = vec4(readState(locations[gl_VertexID]), 1.0);
+}
+)";
+
+static u32 compile(GLenum type, const std::string& source) {
+    u32 shader = glCreateShader(type);
+    const char* text = source.c_str();
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        fprintf(stderr, "Failed to compile shader:\n%s\n", log);
+        exit(1);
+    }
+    return shader;
+}
+
+static u32 link(u32 shader, bool transformFeedback) {
+    u32 program = glCreateProgram();
+    glAttachShader(program, shader);
+    if (transformFeedback) {
+        const char* varying = "v_result";
+        glTransformFeedbackVaryings(program, 1, &varying, GL_INTERLEAVED_ATTRIBS);
+    }
+    glLinkProgram(program);
+    glDeleteShader(shader);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        fprintf(stderr, "Failed to link program\n");
+        exit(1);
+    }
+    return program;
+}
+
+static std::string getPreamble(bool uniformBuffer, u32 drbSize) {
+    std::string preamble = "#version 430\n";
+    if (uniformBuffer)
+        preamble += "#define DRB_UNIFORM_BUFFER\n";
+    preamble += "#define DRB_SIZE " + std::to_string(drbSize) + "\n";
+    return preamble + DRB_DECLARATIONS;
+}
+
+// The median time of a run of ITERATIONS passes, in milliseconds
+template <typename F>
+static double measure(F pass) {
+    std::vector<double> times;
+    for (u32 run = 0; run < RUNS + 1; run++) {
+        glFinish();
+        auto begin = std::chrono::steady_clock::now();
+        for (u32 i = 0; i < ITERATIONS; i++)
+            pass();
+        glFinish();
+        auto end = std::chrono::steady_clock::now();
+
+        // The first run warms up the driver
+        if (run != 0)
+            times.push_back(std::chrono::duration<double, std::milli>(end - begin).count() / ITERATIONS);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+static bool createContext() {
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!getPlatformDisplay)
+        return false;
+
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (!eglInitialize(display, nullptr, nullptr) || !eglBindAPI(EGL_OPENGL_API))
+        return false;
+
+    EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+    return context != EGL_NO_CONTEXT && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+int main(int argc, char** argv) {
+    u32 objectCount = argc > 1 ? (u32)atoi(argv[1]) : 1 << 20;
+
+    if (!createContext()) {
+        fprintf(stderr, "Failed to create an OpenGL 4.3 context\n");
+        return 1;
+    }
+
+    GLint maxUniformBlockSize = 0;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxUniformBlockSize);
+
+    printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    printf("GL_MAX_UNIFORM_BLOCK_SIZE: %d, objects: %u\n\n", maxUniformBlockSize, objectCount);
+    printf("%8s  %12s %12s  %12s %12s\n", "DRB", "compute UBO", "compute SSBO", "vertex UBO", "vertex SSBO");
+
+    u32 drb, locationBuffer, resultBuffer, vao;
+    glGenBuffers(1, &drb);
+    glGenBuffers(1, &locationBuffer);
+    glGenBuffers(1, &resultBuffer);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objectCount * 16, nullptr, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, resultBuffer);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, resultBuffer);
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    // A surfaceless context has no default framebuffer to draw to
+    u32 framebuffer, renderbuffer;
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+    std::mt19937 random(1234);
+    u32 crossover = 0;
+
+    for (u32 drbSize = 1024; drbSize <= (u32)maxUniformBlockSize; drbSize *= 2) {
+        // Random translation states, which are 3 words each
+        std::vector<u32> words(drbSize / 4);
+        for (auto& word : words)
+            word = random();
+
+        u32 stateCount = (u32)words.size() / 3;
+        std::vector<u32> locations(objectCount);
+        for (auto& location : locations)
+            location = random() % stateCount * 3;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, drb);
+        glBufferData(GL_UNIFORM_BUFFER, drbSize, words.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, locationBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, objectCount * 4, locations.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, locationBuffer);
+
+        double times[4];
+        for (u32 i = 0; i < 4; i++) {
+            bool uniformBuffer = i % 2 == 0;
+            bool compute       = i < 2;
+
+            if (uniformBuffer)
+                glBindBufferBase(GL_UNIFORM_BUFFER, 0, drb);
+            else
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, drb);
+
+            auto preamble = getPreamble(uniformBuffer, drbSize);
+            if (compute) {
+                u32 program = link(compile(GL_COMPUTE_SHADER, preamble + COMPUTE_SOURCE), false);
+                glUseProgram(program);
+                glUniform1ui(glGetUniformLocation(program, "u_objectCount"), objectCount);
+                times[i] = measure([&] {
+                    glDispatchCompute((objectCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+                    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                });
+                glDeleteProgram(program);
+            } else {
+                u32 program = link(compile(GL_VERTEX_SHADER, preamble + VERTEX_SOURCE), true);
+                glUseProgram(program);
+                times[i] = measure([&] {
+                    glBeginTransformFeedback(GL_POINTS);
+                    glDrawArrays(GL_POINTS, 0, objectCount);
+                    glEndTransformFeedback();
+                });
+                glDeleteProgram(program);
+            }
+        }
+
+        printf("%6u B  %9.3f ms %9.3f ms  %9.3f ms %9.3f ms\n", drbSize, times[0], times[1], times[2], times[3]);
+
+        bool computeUboSlower = times[1] * (1.0 + NOISE_MARGIN) < times[0];
+        bool vertexUboSlower  = times[3] * (1.0 + NOISE_MARGIN) < times[2];
+        if (!crossover && computeUboSlower && vertexUboSlower)
+            crossover = drbSize;
+    }
+
+    if (crossover)
+        printf("\nCrossover: the storage buffer is faster from %u bytes on\n", crossover);
+    else
+        printf("\nNo crossover: the uniform buffer is never slower up to %d bytes\n", maxUniformBlockSize);
+    return 0;
+}
@@ -0,0 +1,279 @@
+/*
+    Compiles and links every shader of the renderer headless on
+    the Mesa driver of the system through EGL, without the game.
+    With LIBGL_ALWAYS_SOFTWARE=1 that is llvmpipe, so it can run
+    in CI. It exits with 1 if any program fails.
+
+    The sources are put together like the embedded shaders (see
+    cmake/EmbedShaders.cmake and Shader.cpp): the quoted includes
+    are resolved, and the version directive and the macro
+    variables of the renderer are put in front.
+
+    The object shaders are checked with every variant flag on its
+    own, with all of them, and with all of them but one. The compute
+    shaders are checked with the DRB as a storage and a uniform buffer.
+
+    Build: g++ -O2 -std=c++20 benchmarks/shaderCompile.cpp -o shaderCompile -lEGL -lGL
+    Run:   LIBGL_ALWAYS_SOFTWARE=1 ./shaderCompile [shader directory]
+*/
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+using u32 = uint32_t;
+
+// The same as GLSL_VERSION in Shader.cpp
+static const char* VERSION_DIRECTIVE = "#version 450\n";
+
+// The largest size Renderer.cpp passes, see DRB_MAX_UNIFORM_BUFFER_SIZE in shared.h
+static const char* DRB_UNIFORM_BUFFER_SIZE = "65536";
+
+// The macros of objectShaderVariantMacros in Renderer.cpp
+static const char* OBJECT_SHADER_VARIANT_MACROS[] = {
+    "BAKED_OBJECTS",
+    "OPAQUE_PASS",
+    "RESOLVED_OBJECTS",
+    "VERTEX_PULLING",
+    "DRB_UNIFORM_BUFFER",
+    "FEATURE_HSV",
+    "FEATURE_AUDIO_SCALE",
+    "FEATURE_INVISIBLE_BLOCK",
+    "FEATURE_ROTATION",
+    "FEATURE_LOCAL_TRANSFORM",
+    "FEATURE_SPECIAL_GLOW",
+};
+
+static constexpr u32 OBJECT_SHADER_VARIANT_MACRO_COUNT = std::size(OBJECT_SHADER_VARIANT_MACROS);
+
+using MacroVariables = std::map<std::string, std::string>;
+
+static fs::path shaderDirectory = "resources/shaders";
+
+static std::optional<std::string> readFile(const fs::path& path) {
+    std::ifstream file(path);
+    if (!file)
+        return std::nullopt;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return stream.str();
+}
+
+static std::optional<std::string> resolveIncludes(std::string source, u32 depth = 0) {
+    if (depth > 16) {
+        fprintf(stderr, "Shader includes are nested too deep\n");
+        return std::nullopt;
+    }
+
+    static const std::regex includePattern("#include \"([^\"]+)\"");
+
+    std::smatch match;
+    while (std::regex_search(source, match, includePattern)) {
+        auto header = readFile(shaderDirectory / match[1].str());
+        if (!header) {
+            fprintf(stderr, "Could not find included shader file: %s\n", match[1].str().c_str());
+            return std::nullopt;
+        }
+
+        auto resolved = resolveIncludes(header.value(), depth + 1);
+        if (!resolved)
+            return std::nullopt;
+
+        source.replace(match.position(), match.length(), resolved.value());
+    }
+
+    return source;
+}
+
+static std::optional<std::string> loadShader(const std::string& name, const MacroVariables& macroVariables) {
+    auto source = readFile(shaderDirectory / name);
+    if (!source) {
+        fprintf(stderr, "Could not find shader: %s\n", name.c_str());
+        return std::nullopt;
+    }
+
+    auto resolved = resolveIncludes(source.value());
+    if (!resolved)
+        return std::nullopt;
+
+    // The extension is only there for glslang, and the
+    // system includes are only used by the C++ side of shared.h
+    std::string code = std::regex_replace(resolved.value(), std::regex("#extension GL_ARB_shading_language_include[^\n]*"), "");
+    code = std::regex_replace(code, std::regex("#include <[^>\n]*>"), "");
+
+    std::string preCode = "#define GLSL\n";
+    for (auto& [key, value] : macroVariables)
+        preCode += "#define " + key + " " + value + "\n";
+
+    return VERSION_DIRECTIVE + preCode + code;
+}
+
+static u32 compile(GLenum type, const std::string& name, const std::string& source) {
+    u32 shader = glCreateShader(type);
+    const char* text = source.c_str();
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char log[4096];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        fprintf(stderr, "Failed to compile %s:\n%s\n", name.c_str(), log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static bool link(const std::vector<u32>& shaders) {
+    u32 program = glCreateProgram();
+    for (u32 shader : shaders)
+        glAttachShader(program, shader);
+    glLinkProgram(program);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char log[4096];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        fprintf(stderr, "Failed to link program:\n%s\n", log);
+    }
+
+    glDeleteProgram(program);
+    for (u32 shader : shaders)
+        glDeleteShader(shader);
+    return success;
+}
+
+static std::string describeMacroVariables(const MacroVariables& macroVariables) {
+    std::string description;
+    for (auto& [key, value] : macroVariables)
+        description += " " + key;
+    return description.empty() ? " (none)" : description;
+}
+
+static bool checkProgram(const std::string& vertexName, const std::string& fragmentName, const MacroVariables& macroVariables) {
+    auto vertexSource   = loadShader(vertexName, macroVariables);
+    auto fragmentSource = loadShader(fragmentName, macroVariables);
+
+    bool success = false;
+    if (vertexSource && fragmentSource) {
+        u32 vertexShader   = compile(GL_VERTEX_SHADER, vertexName, vertexSource.value());
+        u32 fragmentShader = compile(GL_FRAGMENT_SHADER, fragmentName, fragmentSource.value());
+        if (vertexShader && fragmentShader)
+            success = link({ vertexShader, fragmentShader });
+        else {
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+        }
+    }
+
+    printf("%-4s %s + %s:%s\n", success ? "OK" : "FAIL", vertexName.c_str(), fragmentName.c_str(), describeMacroVariables(macroVariables).c_str());
+    return success;
+}
+
+static bool checkComputeProgram(const std::string& name, const MacroVariables& macroVariables) {
+    auto source = loadShader(name, macroVariables);
+
+    bool success = false;
+    if (source) {
+        u32 shader = compile(GL_COMPUTE_SHADER, name, source.value());
+        if (shader)
+            success = link({ shader });
+    }
+
+    printf("%-4s %s:%s\n", success ? "OK" : "FAIL", name.c_str(), describeMacroVariables(macroVariables).c_str());
+    return success;
+}
+
+static MacroVariables getObjectShaderMacroVariables(u32 variant) {
+    MacroVariables macroVariables;
+    for (u32 i = 0; i < OBJECT_SHADER_VARIANT_MACRO_COUNT; i++) {
+        if (variant & (1 << i))
+            macroVariables[OBJECT_SHADER_VARIANT_MACROS[i]] = "";
+    }
+    if (macroVariables.contains("DRB_UNIFORM_BUFFER"))
+        macroVariables["DRB_UNIFORM_BUFFER_SIZE"] = DRB_UNIFORM_BUFFER_SIZE;
+    return macroVariables;
+}
+
+static bool createContext() {
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!getPlatformDisplay)
+        return false;
+
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (!eglInitialize(display, nullptr, nullptr) || !eglBindAPI(EGL_OPENGL_API))
+        return false;
+
+    EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+    return context != EGL_NO_CONTEXT && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1)
+        shaderDirectory = argv[1];
+
+    if (!createContext()) {
+        fprintf(stderr, "Failed to create an OpenGL 4.3 context\n");
+        return 1;
+    }
+
+    printf("%s, %s, GLSL %s\n\n", glGetString(GL_RENDERER), glGetString(GL_VERSION), glGetString(GL_SHADING_LANGUAGE_VERSION));
+
+    u32 failedCount = 0;
+    u32 checkedCount = 0;
+    auto count = [&](bool success) {
+        checkedCount++;
+        if (!success)
+            failedCount++;
+    };
+
+    count(checkProgram("basic.vert", "basic.frag", {}));
+    count(checkProgram("fullscreen.vert", "differenceMode.frag", {}));
+    count(checkProgram("fullscreen.vert", "overdrawView.frag", {}));
+
+    u32 allVariants = (1 << OBJECT_SHADER_VARIANT_MACRO_COUNT) - 1;
+    std::vector<u32> variants = { 0, allVariants };
+    for (u32 i = 0; i < OBJECT_SHADER_VARIANT_MACRO_COUNT; i++) {
+        variants.push_back(1 << i);
+        variants.push_back(allVariants & ~(1 << i));
+    }
+    for (u32 variant : variants)
+        count(checkProgram("object.vert", "object.frag", getObjectShaderMacroVariables(variant)));
+
+    MacroVariables storageBuffer;
+    MacroVariables uniformBuffer = {
+        { "DRB_UNIFORM_BUFFER",      "" },
+        { "DRB_UNIFORM_BUFFER_SIZE", DRB_UNIFORM_BUFFER_SIZE }
+    };
+    for (auto& macroVariables : { storageBuffer, uniformBuffer }) {
+        count(checkComputeProgram("cullChunks.comp", macroVariables));
+        count(checkComputeProgram("resolveObjects.comp", macroVariables));
+    }
+
+    printf("\n%u of %u program(s) failed\n", failedCount, checkedCount);
+    return failedCount == 0 ? 0 : 1;
+}
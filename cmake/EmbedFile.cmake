@@ -0,0 +1,40 @@
+# Embeds a generated file into the mod binary as a string_view,
+# for files that are built instead of shipped in the resources.
+#
+# Usage: cmake -DINPUT=<file> -DOUTPUT=<header> -DNAME=<identifier> -P EmbedFile.cmake
+
+if (NOT INPUT OR NOT OUTPUT OR NOT NAME)
+    message(FATAL_ERROR "INPUT, OUTPUT and NAME have to be set")
+endif()
+
+file(READ "${INPUT}" bytes HEX)
+
+# 16 bytes per line
+string(REPEAT "0x[0-9a-f][0-9a-f]," 16 row_pattern)
+
+# As bytes with a null terminator, raw string literals have a length limit on MSVC
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${bytes}00")
+string(REGEX REPLACE "(${row_pattern})" "\\1\n    " bytes "${bytes}")
+string(REPLACE ",0x" ", 0x" bytes "${bytes}")
+
+file(WRITE "${OUTPUT}.tmp"
+"// Generated by cmake/EmbedFile.cmake, do not edit
+
+#pragma once
+
+#include <string_view>
+
+namespace embeddedfiles {
+
+inline constexpr char ${NAME}Data[] = {
+    ${bytes}
+};
+
+inline constexpr std::string_view ${NAME} { ${NAME}Data, sizeof(${NAME}Data) - 1 };
+
+}
+")
+
+# Only touches the header when the file changed
+configure_file("${OUTPUT}.tmp" "${OUTPUT}" COPYONLY)
+file(REMOVE "${OUTPUT}.tmp")
@@ -0,0 +1,91 @@
+# Embeds the shaders into the mod binary, so glslang
+# isn't needed to preprocess them at runtime.
+#
+# The quoted #includes are resolved here, just like the
+# includer of Shader.cpp does it. The macro variables of
+# the renderer are left to the preprocessor of the driver.
+#
+# Usage: cmake -DSHADER_DIR=<dir> -DOUTPUT=<header> -P EmbedShaders.cmake
+
+if (NOT SHADER_DIR OR NOT OUTPUT)
+    message(FATAL_ERROR "SHADER_DIR and OUTPUT have to be set")
+endif()
+
+function(resolve_includes source depth out_var)
+    if (depth GREATER 16)
+        message(FATAL_ERROR "Shader includes are nested too deep")
+    endif()
+
+    string(REGEX MATCHALL "#include \"[^\"]+\"" directives "${source}")
+    list(REMOVE_DUPLICATES directives)
+
+    foreach(directive IN LISTS directives)
+        string(REGEX REPLACE "#include \"([^\"]+)\"" "\\1" name "${directive}")
+        if (NOT EXISTS "${SHADER_DIR}/${name}")
+            message(FATAL_ERROR "Could not find included shader file: ${name}")
+        endif()
+
+        file(READ "${SHADER_DIR}/${name}" header)
+        math(EXPR next_depth "${depth} + 1")
+        resolve_includes("${header}" ${next_depth} header)
+
+        string(REPLACE "${directive}" "${header}" source "${source}")
+    endforeach()
+
+    set(${out_var} "${source}" PARENT_SCOPE)
+endfunction()
+
+file(GLOB shader_paths "${SHADER_DIR}/*.vert" "${SHADER_DIR}/*.frag" "${SHADER_DIR}/*.comp")
+list(SORT shader_paths)
+
+# 16 bytes per line
+string(REPEAT "0x[0-9a-f][0-9a-f]," 16 row_pattern)
+
+set(definitions "")
+set(table "")
+
+foreach(path IN LISTS shader_paths)
+    get_filename_component(name "${path}" NAME)
+    string(MAKE_C_IDENTIFIER "${name}" identifier)
+
+    file(READ "${path}" source)
+    resolve_includes("${source}" 0 source)
+
+    # The extension is only there for glslang, and the
+    # system includes are only used by the C++ side of shared.h
+    string(REGEX REPLACE "#extension GL_ARB_shading_language_include[^\n]*" "" source "${source}")
+    string(REGEX REPLACE "#include <[^>\n]*>" "" source "${source}")
+
+    # As bytes with a null terminator, raw string literals have a length limit on MSVC
+    string(HEX "${source}" bytes)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${bytes}00")
+    string(REGEX REPLACE "(${row_pattern})" "\\1\n    " bytes "${bytes}")
+    string(REPLACE ",0x" ", 0x" bytes "${bytes}")
+
+    string(APPEND definitions "inline constexpr char ${identifier}[] = {\n    ${bytes}\n};\n\n")
+    string(APPEND table "    { \"${name}\", { ${identifier}, sizeof(${identifier}) - 1 } },\n")
+endforeach()
+
+file(WRITE "${OUTPUT}.tmp"
+"// Generated by cmake/EmbedShaders.cmake, do not edit
+
+#pragma once
+
+#include <string_view>
+
+namespace embeddedshaders {
+
+${definitions}struct EmbeddedShader {
+    std::string_view name;
+    std::string_view source;
+};
+
+inline constexpr EmbeddedShader shaders[] = {
+${table}};
+
+}
+")
+
+# Only touches the header when a shader changed
+configure_file("${OUTPUT}.tmp" "${OUTPUT}" COPYONLY)
+file(REMOVE "${OUTPUT}.tmp")
@@ -0,0 +1,298 @@
+/*
+    Generates spriteOpaqueMeshes.json from the sprite sheets of the game.
+    The build runs this when BISMUTH_GD_RESOURCES is set, and embeds the
+    output into the mod binary (see CMakeLists.txt).
+
+    Usage: node codegenSpriteOpaqueMeshes.js <path to the Resources folder of Geometry Dash> <output path>
+
+    For every sprite frame, this finds a few large rectangles that only
+    cover texels with an alpha of 255. These are the opaque interiors
+    drawn by the depth pass. The rectangles are in the same space as
+    resources/spriteMeshes.json: (0, 0) is the bottom left and (1, 1)
+    the top right of the texture rect of the frame.
+*/
+
+const fs   = require('fs');
+const path = require('path');
+const zlib = require('zlib');
+
+// The glow sheet is skipped, glow sprites are always blended
+const SHEETS = [
+    'GJ_GameSheet-uhd',
+    'GJ_GameSheet02-uhd',
+    'GJ_ParticleSheet-uhd',
+    'FireSheet_01-uhd',
+    'PixelSheet_01-uhd'
+];
+
+/*
+    The rectangles are shrunk by this amount of uhd texels. The
+    game can use lower quality sheets (up to 4x smaller), and texture
+    filtering blends in the texels next to the edge of the rectangle.
+*/
+const EROSION = 4;
+
+const MAX_RECTANGLES_PER_FRAME = 4;
+
+// Smaller rectangles are not worth the extra vertices
+const MIN_RECTANGLE_AREA     = 64;
+const MIN_RECTANGLE_FRACTION = 0.05;
+
+//// PNG DECODING ////
+
+function paeth(a, b, c) {
+    const p  = a + b - c;
+    const pa = Math.abs(p - a);
+    const pb = Math.abs(p - b);
+    const pc = Math.abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+// Only supports 8-bit non-interlaced RGBA images, which is what the sheets are
+function decodePNG(file) {
+    const data = fs.readFileSync(file);
+
+    let width = 0, height = 0;
+    const idat = [];
+
+    let offset = 8;
+    while (offset < data.length) {
+        const length = data.readUInt32BE(offset);
+        const type   = data.toString('ascii', offset + 4, offset + 8);
+        const chunk  = data.subarray(offset + 8, offset + 8 + length);
+
+        if (type == 'IHDR') {
+            width  = chunk.readUInt32BE(0);
+            height = chunk.readUInt32BE(4);
+
+            const bitDepth  = chunk[8];
+            const colorType = chunk[9];
+            const interlace = chunk[12];
+            if (bitDepth != 8 || colorType != 6 || interlace != 0)
+                throw new Error(file + ": only 8-bit non-interlaced RGBA images are supported");
+        } else if (type == 'IDAT')
+            idat.push(chunk);
+        else if (type == 'IEND')
+            break;
+
+        offset += length + 12;
+    }
+
+    const raw    = zlib.inflateSync(Buffer.concat(idat));
+    const stride = width * 4;
+    const pixels = Buffer.alloc(stride * height);
+
+    for (let y = 0; y < height; y++) {
+        const filter = raw[y * (stride + 1)];
+        const line   = raw.subarray(y * (stride + 1) + 1, (y + 1) * (stride + 1));
+
+        for (let x = 0; x < stride; x++) {
+            const a = x >= 4 ? pixels[y * stride + x - 4] : 0;
+            const b = y > 0  ? pixels[(y - 1) * stride + x] : 0;
+            const c = (x >= 4 && y > 0) ? pixels[(y - 1) * stride + x - 4] : 0;
+
+            let value = line[x];
+            switch (filter) {
+            case 1: value += a; break;
+            case 2: value += b; break;
+            case 3: value += (a + b) >> 1; break;
+            case 4: value += paeth(a, b, c); break;
+            }
+
+            pixels[y * stride + x] = value & 0xff;
+        }
+    }
+
+    return { width, height, pixels };
+}
+
+//// PLIST PARSING ////
+
+function parsePlist(file) {
+    const source = fs.readFileSync(file, 'utf8');
+    const tokens = [...source.matchAll(/<(\/?)(\w+)\s*(\/?)>|([^<]+)/g)];
+
+    let index = 0;
+
+    function nextTag() {
+        while (index < tokens.length && !tokens[index][2])
+            index++;
+        return tokens[index++];
+    }
+
+    function textUntilClose() {
+        let text = "";
+        while (index < tokens.length && tokens[index][4] !== undefined)
+            text += tokens[index++][4];
+        index++; // closing tag
+        return text.trim();
+    }
+
+    function parseValue(tag) {
+        const name = tag[2];
+        if (tag[3]) {
+            if (name == 'true')  return true;
+            if (name == 'false') return false;
+            return name == 'dict' ? {} : (name == 'array' ? [] : "");
+        }
+
+        switch (name) {
+        case 'dict': {
+            const dict = {};
+            for (;;) {
+                const keyTag = nextTag();
+                if (keyTag[1]) return dict;
+                const key = textUntilClose();
+                dict[key] = parseValue(nextTag());
+            }
+        }
+        case 'array': {
+            const array = [];
+            for (;;) {
+                const valueTag = nextTag();
+                if (valueTag[1]) return array;
+                array.push(parseValue(valueTag));
+            }
+        }
+        case 'integer':
+        case 'real':
+            return Number(textUntilClose());
+        default:
+            return textUntilClose();
+        }
+    }
+
+    let tag = nextTag();
+    while (tag && tag[2] != 'dict')
+        tag = nextTag();
+    return parseValue(tag);
+}
+
+function parseNumbers(string) {
+    return string.match(/-?[\d.]+/g).map(Number);
+}
+
+//// RECTANGLE SEARCH ////
+
+// Returns the largest rectangle of set cells in the mask, using the histogram method
+function findLargestRectangle(mask, width, height) {
+    const heights = new Int32Array(width);
+    let best = { area: 0 };
+
+    for (let y = 0; y < height; y++) {
+        for (let x = 0; x < width; x++)
+            heights[x] = mask[y * width + x] ? heights[x] + 1 : 0;
+
+        const stack = [];
+        for (let x = 0; x <= width; x++) {
+            const h = x < width ? heights[x] : 0;
+            let start = x;
+
+            while (stack.length && stack[stack.length - 1].height >= h) {
+                const top  = stack.pop();
+                const area = top.height * (x - top.start);
+                if (area > best.area)
+                    best = { area, x0: top.start, x1: x, y0: y - top.height + 1, y1: y + 1 };
+                start = top.start;
+            }
+
+            stack.push({ start, height: h });
+        }
+    }
+
+    return best;
+}
+
+function generateFrameMesh(image, frame) {
+    const [rx, ry, rw, rh] = frame.rect;
+    if (rw <= EROSION * 2 || rh <= EROSION * 2)
+        return null;
+
+    // Cell (u, v) of the mask, v = 0 being the bottom of the sprite
+    const isOpaque = (u, v) => {
+        if (u < 0 || v < 0 || u >= rw || v >= rh)
+            return false;
+
+        const px = frame.rotated ? rx + v : rx + u;
+        const py = frame.rotated ? ry + u : ry + rh - 1 - v;
+        return image.pixels[(py * image.width + px) * 4 + 3] == 255;
+    };
+
+    // A cell is only kept when every cell within the erosion distance is opaque
+    const mask = new Uint8Array(rw * rh);
+    for (let v = 0; v < rh; v++) {
+        for (let u = 0; u < rw; u++) {
+            let opaque = true;
+            for (let dv = -EROSION; dv <= EROSION && opaque; dv++)
+                for (let du = -EROSION; du <= EROSION && opaque; du++)
+                    opaque = isOpaque(u + du, v + dv);
+            mask[v * rw + u] = opaque ? 1 : 0;
+        }
+    }
+
+    const minArea = Math.max(MIN_RECTANGLE_AREA, rw * rh * MIN_RECTANGLE_FRACTION);
+    const polygons = [];
+
+    while (polygons.length < MAX_RECTANGLES_PER_FRAME) {
+        const rect = findLargestRectangle(mask, rw, rh);
+        if (rect.area < minArea)
+            break;
+
+        for (let v = rect.y0; v < rect.y1; v++)
+            mask.fill(0, v * rw + rect.x0, v * rw + rect.x1);
+
+        const u0 = rect.x0 / rw, u1 = rect.x1 / rw;
+        const v0 = rect.y0 / rh, v1 = rect.y1 / rh;
+
+        // Counter clockwise, like in spriteMeshes.json
+        polygons.push([ [u0, v0], [u1, v0], [u1, v1], [u0, v1] ]);
+    }
+
+    return polygons.length ? polygons : null;
+}
+
+function getFrames(plist) {
+    const frames = [];
+
+    for (const [name, info] of Object.entries(plist.frames)) {
+        // Format 3 uses textureRect and textureRotated, format 2 uses frame and rotated
+        const rect    = parseNumbers(info.textureRect ?? info.frame);
+        const rotated = info.textureRotated ?? info.rotated ?? false;
+
+        frames.push({ name, rect, rotated });
+    }
+
+    return frames;
+}
+
+function main() {
+    const resourcesPath = process.argv[2];
+    const outputPath    = process.argv[3];
+    if (!resourcesPath || !outputPath) {
+        console.log("Usage: node codegenSpriteOpaqueMeshes.js <path to the Resources folder of Geometry Dash> <output path>");
+        process.exit(1);
+    }
+
+    const meshes = {};
+    let frameCount = 0;
+
+    for (const sheet of SHEETS) {
+        const image = decodePNG(path.join(resourcesPath, sheet + '.png'));
+        const plist = parsePlist(path.join(resourcesPath, sheet + '.plist'));
+
+        for (const frame of getFrames(plist)) {
+            const mesh = generateFrameMesh(image, frame);
+            if (mesh)
+                meshes[frame.name] = mesh;
+            frameCount++;
+        }
+    }
+
+    fs.writeFileSync(outputPath, JSON.stringify(meshes));
+
+    console.log(`Generated opaque meshes for ${Object.keys(meshes).length} of ${frameCount} frames`);
+}
+
+main();
@@ -21,28 +21,28 @@ flat in int  t_spriteSheet;
 flat in uint t_blending;
 flat in uint t_shaderSprite;
 
-vec4 getTextureColor() {
-    if (t_shaderSprite == 0)
-        return texture(SPRITESHEET_TEXTURE, t_texCoord);
-    else
-        return vec4(1.0, 1.0, 1.0, 1.0);
+vec4 getTextureColor(vec2 texCoordWidth) {
+    // Shader sprites don't need a texture fetch
+    if (t_shaderSprite != 0)
+        return sampleShaderSprite(t_shaderSprite, t_texCoord, texCoordWidth);
 
-    // return sampleShaderSprite(t_shaderSprite, t_texCoord);
+    // The sprite sheets have no mipmaps, this avoids implicit derivatives in the branch
+    return textureLod(SPRITESHEET_TEXTURE, t_texCoord, 0.0);
 }
 
 void main() {
-    // vec4 texColor;
-    
-    // if (t_shaderSprite == 0)
-    //     texColor = texture(SPRITESHEET_TEXTURE, t_texCoord);
-    // else
-    //     texColor = vec4(1.0, 1.0, 1.0, 1.0);
-
-    if (t_blending == 0) {
-        FragColor = texture(SPRITESHEET_TEXTURE, t_texCoord) * t_color;
-    } else {
-        vec4 texColor = texture(SPRITESHEET_TEXTURE, t_texCoord);
-        FragColor = texColor * t_color;
+    // Derivatives have to be taken outside of the branches
+    vec2 texCoordWidth = fwidth(t_texCoord);
+
+    vec4 texColor = getTextureColor(texCoordWidth);
+
+    FragColor = texColor * t_color;
+    if (t_blending != 0)
         FragColor.rgb *= texColor.a;
-    }
+
+#ifdef OPAQUE_PASS
+    // This is a separate shader variant, a discard would stop early depth testing in the translucent pass
+    if (FragColor.a < 1.0)
+        discard;
+#endif
 }
\ No newline at end of file
@@ -1,14 +1,31 @@
 #extension GL_ARB_shading_language_include:require
 
 #include "shared.h"
+#include "objectState.glsl"
 
 //// VERTEX ATTRIBUTES ////
+#ifdef VERTEX_PULLING
+// There are no vertex attributes, these are filled in by pullVertex()
+vec2 a_positionOffset;
+vec2 a_texCoord;
+int  a_srbIndex;
+uint a_colorChannel;
+int  a_spriteSheet;
+uint a_shaderSprite;
+#else
 layout (location = 0) in vec2 a_positionOffset;
 layout (location = 1) in vec2 a_texCoord;
 layout (location = 2) in int  a_srbIndex;
 layout (location = 3) in uint a_colorChannel;
 layout (location = 4) in int  a_spriteSheet;
 layout (location = 5) in uint a_shaderSprite;
+#endif
+
+// The amount of draw order steps before this batch, see drawOrderIndex
+uniform uint u_depthOrderOffset;
+
+// The depth pass needs the exact same depth in both passes
+invariant gl_Position;
 
 //// VARIABLES TO BE TRANSFERED TO THE FRAGMENT SHADER ////
      out vec2 t_texCoord;
@@ -17,27 +34,48 @@ flat out int  t_spriteSheet;
 flat out uint t_blending;
 flat out uint t_shaderSprite;
 
-#define SRB_OBJECT (srb.objects[a_srbIndex])
+#define SRB_OBJECT      (srb.objects[a_srbIndex])
+#define RESOLVED_OBJECT (rob.resolvedObjects[a_srbIndex])
 
 //// GLOBALS ////
 uint  objectFlags;
 vec2  objectPosition;
 float objectOpacity = 1.0;
 vec2  vertexOffset;
+// Vertices (or sprites with vertex pulling) drawn later get a lower depth
+uint  drawOrderIndex;
 
 //// HELPER FUNCTION PREDECLARATIONS ////
-float calculateAudioScale();
+void pullVertex();
 vec4 calculateInvisibleBlockColorAndOpacity(vec4 color);
 vec4 applyHSV(HSV hsvValue, vec4 color);
 
 //// MAIN FUNCTION ////
 void main() {
+    drawOrderIndex = uint(gl_VertexID);
+
+#ifdef VERTEX_PULLING
+    pullVertex();
+#endif
+
     //// CALCULATING VERTEX POSITION ////
-    
+
+#ifdef BAKED_OBJECTS
+    // Baked objects are already in world space and don't use the SRB
+    objectFlags = 0;
+    gl_Position = u_mvp * vec4(a_positionOffset, 0.0, 1.0);
+#elif defined(RESOLVED_OBJECTS)
+    // Everything per object is already done by resolveObjects.comp
+    ResolvedObject object = RESOLVED_OBJECT;
+    objectFlags   = object.flags;
+    objectOpacity = a_spriteSheet == SPRITE_SHEET_GLOW ? object.glowOpacity : object.opacity;
+
+    gl_Position = u_mvp * vec4(object.position + object.transform * a_positionOffset, 0.0, 1.0);
+#else
     objectPosition = SRB_OBJECT.startPosition;
 
     // APPLY GROUP COMBINATION STATE
-    GroupCombinationState state = drb.groupCombinationStates[SRB_OBJECT.groupCombinationIndex];
+    GroupCombinationState state = getGroupCombinationState(SRB_OBJECT.groupStateLocation);
     objectPosition = state.positionalTransform * objectPosition + state.offset;
     
     vertexOffset = a_positionOffset;
@@ -46,50 +84,79 @@ void main() {
     objectOpacity *= SRB_OBJECT.opacity;
     objectOpacity *= state.opacity;
 
+    // The FEATURE_* macros are only set for batches with objects that need them
+#ifdef FEATURE_LOCAL_TRANSFORM
     if ((objectFlags & OBJECT_FLAG_IS_STATIC_OBJECT) == 0)
         vertexOffset = state.localTransform * vertexOffset;
+#endif
 
+#ifdef FEATURE_ROTATION
     if (SRB_OBJECT.rotationSpeed != 0.0) // TODO: Just supply rotation speed in radians instead
         vertexOffset = rotatePointAroundOrigin(vertexOffset, -SRB_OBJECT.rotationSpeed * u_timer / 180 * PI);
+#endif
 
+#ifdef FEATURE_AUDIO_SCALE
     if ((objectFlags & OBJECT_FLAG_USES_AUDIO_SCALE) != 0)
-        vertexOffset *= calculateAudioScale();
+        vertexOffset *= calculateAudioScale(SRB_OBJECT);
+#endif
 
     gl_Position = u_mvp * vec4(objectPosition + vertexOffset, 0.0, 1.0);
+#endif
+
+    float drawOrder = float(u_depthOrderOffset + drawOrderIndex + 1u);
+    gl_Position.z = (1.0 - 2.0 * drawOrder * u_depthScale) * gl_Position.w;
 
     //// TRANSFERING VARIABLES TO FRAGMENT SHADER ////
 
-    uint colorChannel = a_colorChannel & 0xfff;
+    // The color of the entry in the color table, resolved by the CPU
+    ColorTableEntry colorEntry = ctb.colorTable[a_colorChannel & A_COLOR_CHANNEL_MASK];
+    t_color    = RGBA_TO_VEC4(colorEntry.color);
+    t_blending = colorEntry.flags & COLOR_ENTRY_BLENDING;
 
     t_spriteSheet  = a_spriteSheet;
-    t_color        = RGBA_TO_VEC4(drb.channelColors[colorChannel]);
     t_shaderSprite = a_shaderSprite;
     t_texCoord     = a_texCoord;
 
+#ifdef FEATURE_SPECIAL_GLOW
     if (a_spriteSheet == SPRITE_SHEET_GLOW && (objectFlags & OBJECT_FLAG_SPECIAL_GLOW_COLOR) != 0)
         t_color = vec4(u_specialLightBGColor, 1.0);
+#endif
 
-    t_blending = BITMAP_GET(drb.colorChannelBlendingBitmap, colorChannel);
     if (a_spriteSheet == SPRITE_SHEET_GLOW)
         t_blending = 1;
-    
+
+#ifdef FEATURE_INVISIBLE_BLOCK
     if ((objectFlags & OBJECT_FLAG_IS_INVISIBLE_BLOCK) != 0)
         t_color = calculateInvisibleBlockColorAndOpacity(t_color);
-
-    if ((a_colorChannel & A_COLOR_CHANNEL_IS_SPRITE_DETAIL) == 0) {
-        if ((objectFlags & OBJECT_FLAG_HAS_BASE_HSV) != 0)
-            t_color = applyHSV(SRB_OBJECT.baseHSV, t_color);
-    } else {
-        if ((objectFlags & OBJECT_FLAG_HAS_DETAIL_HSV) != 0)
-            t_color = applyHSV(SRB_OBJECT.detailHSV, t_color);
+#endif
+
+#ifdef FEATURE_HSV
+    // Sprites with an HSV entry in the color table already have their HSV applied
+    if ((colorEntry.flags & COLOR_ENTRY_HSV_APPLIED) == 0) {
+        if ((a_colorChannel & A_COLOR_CHANNEL_IS_SPRITE_DETAIL) == 0) {
+            if ((objectFlags & OBJECT_FLAG_HAS_BASE_HSV) != 0)
+                t_color = applyHSV(SRB_OBJECT.baseHSV, t_color);
+        } else {
+            if ((objectFlags & OBJECT_FLAG_HAS_DETAIL_HSV) != 0)
+                t_color = applyHSV(SRB_OBJECT.detailHSV, t_color);
+        }
     }
+#endif
 
     t_color.a *= objectOpacity;
 
-    if (t_color.a < 0.01) {
+    if (t_color.a < MIN_VISIBLE_OPACITY) {
+        gl_Position = vec4(5, 5, 5, 1);
+        return;
+    }
+
+#ifdef OPAQUE_PASS
+    // Only sprites on non-blending channels at full opacity can be opaque
+    if (t_blending != 0 || t_color.a < 1.0) {
         gl_Position = vec4(5, 5, 5, 1);
         return;
     }
+#endif
 
     t_color.rgb *= t_color.a;
     if (t_blending != 0) {
@@ -100,59 +167,40 @@ void main() {
 
 //// HELPER FUNCTIONS ////
 
-float calculateAudioScale() {
-    float scale;
-    if ((objectFlags & OBJECT_FLAG_CUSTOM_AUDIO_SCALE) != 0) {
-        float minScale = SRB_OBJECT.audioScaleMin;
-        float maxScale = SRB_OBJECT.audioScaleMax;
-        scale = (u_audioScale - 0.1) * (maxScale - minScale) + minScale;
-    } else
-        scale = u_audioScale;
-
-    if ((objectFlags & OBJECT_FLAG_IS_ORB) != 0)
-        scale = min(scale + 0.3, 1.2);
-    return scale;
-}
-
-float getRelativeMod(float xPos, float left, float right, float offset) {
-    float result = u_cameraViewSize.x * 0.5;
-
-    if (xPos > result + u_cameraPosition.x)
-        result = (result - (xPos - offset - u_cameraPosition.x - result)) * right;
-    else
-        result = (result - (result + u_cameraPosition.x - xPos - offset)) * left;
-
-    return clamp(result, 0.0, 1.0);
-}
-
-vec2 calculateInvisibleBlockOpacity() {
-    float centerLeftX  = u_winSize.x * 0.5 - 75.0;
-    float centerRightX = centerLeftX + 110.0;
-    float someScreenLeft = u_screenRight - centerRightX - 90.0;
+#ifdef VERTEX_PULLING
+void pullVertex() {
+    uint spriteIndex = uint(gl_VertexID) >> SPRITE_MESH_POINT_BITS;
+    uint pointIndex  = uint(gl_VertexID) & SPRITE_MESH_POINT_MASK;
 
-    float fadePosX = objectPosition.x;
-    if (fadePosX <= u_cameraUnzoomedX)
-        fadePosX += SRB_OBJECT.fadeMargin;
-    else
-        fadePosX -= SRB_OBJECT.fadeMargin;
-    
-    float relMod = getRelativeMod(fadePosX, 0.02, 0.014285714, 0.0);
+    ObjectSprite sprite = osb.sprites[spriteIndex];
+    vec2 point = mpb.meshPoints[sprite.firstMeshPoint + pointIndex];
 
-    // INVISIBLE BLOCK OPACITY IS INACCURATE AND I CAN'T SEEM TO FIGURE IT OUT, I'M GOING CRAZY
+    a_positionOffset = sprite.positionBottomLeft +
+                       sprite.positionRight * point.x +
+                       sprite.positionUp    * point.y;
 
-    float someWidth1;
-    if (fadePosX <= centerRightX + u_cameraPosition.x)
-        someWidth1 = (centerLeftX + u_cameraPosition.x - fadePosX) / max(centerLeftX - 30.0, 1.0);
+    if ((sprite.info & OBJECT_SPRITE_TEXTURE_ROTATED) != 0)
+        a_texCoord = sprite.texCoordBottomLeft + sprite.texCoordSize.yx * point.yx;
     else
-        someWidth1 = (fadePosX - u_cameraPosition.x - centerRightX) / max(someScreenLeft, 1.0);
-
-    someWidth1 = clamp(someWidth1, 0.0, 1.0);
+        a_texCoord = sprite.texCoordBottomLeft + sprite.texCoordSize * point;
+
+    a_srbIndex     = int(sprite.srbIndex);
+    a_colorChannel = sprite.colorChannel;
+    a_spriteSheet  = int(sprite.info & OBJECT_SPRITE_SHEET_MASK);
+    a_shaderSprite = (sprite.info >> OBJECT_SPRITE_SHADER_SPRITE_BIT) & OBJECT_SPRITE_SHADER_SPRITE_MASK;
+
+    // Shader sprites are sampled with the position in the sprite
+    if (a_shaderSprite != 0) {
+        a_texCoord = vec2(
+            (sprite.info & OBJECT_SPRITE_SHADER_FLIP_X) != 0 ? 1.0 - point.x : point.x,
+            (sprite.info & OBJECT_SPRITE_SHADER_FLIP_Y) != 0 ? 1.0 - point.y : point.y
+        );
+    }
 
-    return vec2(
-        min(someWidth1 * 0.95 + 0.05, relMod),
-        min(someWidth1 * 0.85 + 0.15, relMod)
-    );
+    // All vertices of a sprite have the same depth
+    drawOrderIndex = spriteIndex;
 }
+#endif
 
 vec4 calculateInvisibleBlockColorAndOpacity(vec4 color) {
     if ((u_gameStateFlags & GAME_STATE_IS_PLAYER_DEAD) != 0) {
@@ -161,26 +209,25 @@ vec4 calculateInvisibleBlockColorAndOpacity(vec4 color) {
         return color;
     }
 
-    vec2 opacity = calculateInvisibleBlockOpacity();
+#ifdef RESOLVED_OBJECTS
+    // The fade is already applied to the opacity of the object
+    vec2  opacity = vec2(1.0, 1.0);
+    float fade    = RESOLVED_OBJECT.invisibleBlockFade;
+#else
+    vec2  opacity = calculateInvisibleBlockOpacity(objectPosition, SRB_OBJECT.fadeMargin);
+    float fade    = opacity.x;
+#endif
 
     if (a_spriteSheet != SPRITE_SHEET_GLOW) {
         color.a *= opacity.x;
     } else {
-        // Might have to do some of these calculations on the cpu instead
-        vec3 colorBG  = RGBA_TO_VEC4(drb.channelColors[COLOR_CHANNEL_BG]).rgb;
-        vec3 colorLBG = RGBA_TO_VEC4(drb.channelColors[COLOR_CHANNEL_LBG]).rgb;
-
-        vec3 colorB;
-        if ((colorBG.r + colorBG.g + colorBG.b) >= (150.0 / 255.0))
-            colorB = vec3(1, 1, 1);
-        else
-            colorB = colorLBG;
+        vec3 colorB = u_invisibleBlockGlowColor;
 
         vec3 glowColor;
-        if (opacity.x <= 0.8)
+        if (fade <= 0.8)
             glowColor = u_specialLightBGColor;
         else
-            glowColor = mix(colorB, u_specialLightBGColor, (1.0 - (opacity.x - 0.8) / 0.2) * 0.3 + 0.7);
+            glowColor = mix(colorB, u_specialLightBGColor, (1.0 - (fade - 0.8) / 0.2) * 0.3 + 0.7);
         color = vec4(glowColor, color.a * opacity.y);
     }
 
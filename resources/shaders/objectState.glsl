@@ -0,0 +1,67 @@
+//////////////////////
+//// OBJECT STATE ////
+//////////////////////
+
+/*
+    The per object math of the object shader. It is used by
+    object.vert for every vertex, or by resolveObjects.comp
+    once per object when the resolve pass is enabled.
+*/
+
+float calculateAudioScale(StaticObjectInfo object) {
+    float scale;
+    if ((object.flags & OBJECT_FLAG_CUSTOM_AUDIO_SCALE) != 0) {
+        float minScale = object.audioScaleMin;
+        float maxScale = object.audioScaleMax;
+        scale = (u_audioScale - 0.1) * (maxScale - minScale) + minScale;
+    } else
+        scale = u_audioScale;
+
+    if ((object.flags & OBJECT_FLAG_IS_ORB) != 0)
+        scale = min(scale + ORB_AUDIO_SCALE_OFFSET, ORB_MAX_AUDIO_SCALE);
+    return scale;
+}
+
+float getRelativeMod(float xPos, float left, float right, float offset) {
+    float result = u_cameraViewSize.x * 0.5;
+
+    if (xPos > result + u_cameraPosition.x)
+        result = (result - (xPos - offset - u_cameraPosition.x - result)) * right;
+    else
+        result = (result - (result + u_cameraPosition.x - xPos - offset)) * left;
+
+    return clamp(result, 0.0, 1.0);
+}
+
+/*
+    The fade of an invisible block at its current position. The
+    x component is for the normal sprites and y for the glow.
+*/
+vec2 calculateInvisibleBlockOpacity(vec2 objectPosition, float fadeMargin) {
+    float centerLeftX  = u_winSize.x * 0.5 - 75.0;
+    float centerRightX = centerLeftX + 110.0;
+    float someScreenLeft = u_screenRight - centerRightX - 90.0;
+
+    float fadePosX = objectPosition.x;
+    if (fadePosX <= u_cameraUnzoomedX)
+        fadePosX += fadeMargin;
+    else
+        fadePosX -= fadeMargin;
+
+    float relMod = getRelativeMod(fadePosX, 0.02, 0.014285714, 0.0);
+
+    // INVISIBLE BLOCK OPACITY IS INACCURATE AND I CAN'T SEEM TO FIGURE IT OUT, I'M GOING CRAZY
+
+    float someWidth1;
+    if (fadePosX <= centerRightX + u_cameraPosition.x)
+        someWidth1 = (centerLeftX + u_cameraPosition.x - fadePosX) / max(centerLeftX - 30.0, 1.0);
+    else
+        someWidth1 = (fadePosX - u_cameraPosition.x - centerRightX) / max(someScreenLeft, 1.0);
+
+    someWidth1 = clamp(someWidth1, 0.0, 1.0);
+
+    return vec2(
+        min(someWidth1 * 0.95 + 0.05, relMod),
+        min(someWidth1 * 0.85 + 0.15, relMod)
+    );
+}
@@ -2,12 +2,20 @@
 //// SHADER SPRITES ////
 ////////////////////////
 
-vec4 shaderSpriteSolidBlock(vec2 pos) {
+/*
+    The colors are premultiplied. pos is the position in the sprite
+    and posWidth is how much pos changes between fragments, used to
+    smooth out edges like texture filtering would.
+*/
+
+vec4 shaderSpriteSolidBlock(vec2 pos, vec2 posWidth) {
     return vec4(1.0, 1.0, 1.0, 1.0);
 }
 
-vec4 shaderSpriteSoildSlope(vec2 pos) {
-    float a = ( (1.0 - pos.x + pos.y) < 1.0 ) ? 1.0 : 0.0;
+// The bottom right half is filled
+vec4 shaderSpriteSolidSlope(vec2 pos, vec2 posWidth) {
+    float distance = pos.x - pos.y;
+    float a = clamp(distance / max(posWidth.x + posWidth.y, 0.00001) + 0.5, 0.0, 1.0);
     return vec4(a, a, a, a);
 }
 
@@ -15,11 +23,11 @@ vec4 shaderSpriteSoildSlope(vec2 pos) {
 //// SHADER SPRITE SAMPLER FUNCTION ////
 ////////////////////////////////////////
 
-vec4 sampleShaderSprite(uint id, vec2 pos) {
+vec4 sampleShaderSprite(uint id, vec2 pos, vec2 posWidth) {
     switch (id) {
-    case SHADER_SPRITE_SOLID_BLOCK: return shaderSpriteSolidBlock(pos);
-    case SHADER_SPRITE_SOLID_SLOPE: return shaderSpriteSoildSlope(pos);
+    case SHADER_SPRITE_SOLID_BLOCK: return shaderSpriteSolidBlock(pos, posWidth);
+    case SHADER_SPRITE_SOLID_SLOPE: return shaderSpriteSolidSlope(pos, posWidth);
     }
     
     return vec4(0.0, 0.0, 0.0, 0.0);
-}
\ No newline at end of file
+}
@@ -19,15 +19,12 @@
 #define mat2 alignas(8)  glm::mat2
 #define mat3 alignas(16) glm::mat3
 #define mat4 alignas(16) glm::mat4
+#define uvec4 alignas(16) glm::uvec4
 #define bool alignas(4) bool
 #define uint unsigned int
 
 struct alignas(4) RGBA { u8 r, g, b, a; };
 
-// In GLSL, these defines are set by the renderer
-#define GROUP_ID_LIMIT     0
-#define TOTAL_OBJECT_COUNT 0
-
 #define GLSL_ONLY(D)
 #define CPP_ONLY(D) D
 
@@ -85,8 +82,18 @@ vec2 rotatePointAroundOrigin(vec2 point, float angleInRadians) {
 #define COLOR_CHANNEL_COUNT  1101
 #define GROUP_IDS_PER_OBJECT 10
 
+#define A_COLOR_CHANNEL_MASK             0xfff
 #define A_COLOR_CHANNEL_IS_SPRITE_DETAIL 0x1000
 
+/*
+    The colorChannel of a sprite is the index of its entry in
+    the color table, not the actual color channel. See ColorTable.hpp.
+*/
+#define COLOR_TABLE_SIZE (A_COLOR_CHANNEL_MASK + 1)
+
+#define COLOR_ENTRY_BLENDING    (1 << 0)
+#define COLOR_ENTRY_HSV_APPLIED (1 << 1)
+
 #define OBJECT_FLAG_USES_AUDIO_SCALE   (1 << 0)
 #define OBJECT_FLAG_CUSTOM_AUDIO_SCALE (1 << 1)
 #define OBJECT_FLAG_IS_ORB             (1 << 2)
@@ -96,6 +103,16 @@ vec2 rotatePointAroundOrigin(vec2 point, float angleInRadians) {
 #define OBJECT_FLAG_HAS_DETAIL_HSV     (1 << 6)
 #define OBJECT_FLAG_IS_STATIC_OBJECT   (1 << 7)
 
+/*
+    Orbs pulse a bit more than the audio scale, up to
+    ORB_MAX_AUDIO_SCALE. The audio scale itself stays
+    below that (a custom scale maps 0.1 - 1.1 to its
+    range), so it bounds every pulsating object that
+    doesn't have a custom scale.
+*/
+#define ORB_AUDIO_SCALE_OFFSET 0.3
+#define ORB_MAX_AUDIO_SCALE    1.2
+
 #define GAME_STATE_IS_PLAYER_DEAD (1 << 0)
 
 #define COLOR_CHANNEL_BG      1000
@@ -138,7 +155,8 @@ struct StaticObjectInfo {
     float opacity;
     HSV baseHSV;
     HSV detailHSV;
-    uint groupCombinationIndex;
+    // See GROUP_STATE_IS_AFFINE
+    uint groupStateLocation;
 };
 
 /*
@@ -150,9 +168,130 @@ struct GroupCombinationState {
     mat2 localTransform;
     vec2 offset;
     float opacity;
-    uint _padding;
 };
 
+/*
+    The states are packed into the DRB every frame. Group
+    combinations that are never rotated only store their offset
+    and their opacity as a half float. The others also store
+    both transforms first.
+
+    The location of a state is its offset in the DRB, with
+    GROUP_STATE_IS_AFFINE set when it stores the transforms.
+*/
+#define GROUP_STATE_IS_AFFINE        0x80000000u
+#define GROUP_STATE_OFFSET_MASK      0x7fffffffu
+#define TRANSLATION_GROUP_STATE_SIZE 3
+#define AFFINE_GROUP_STATE_SIZE      (TRANSLATION_GROUP_STATE_SIZE + 8)
+
+/*
+    The color of an entry of the color table,
+    resolved by the CPU every frame.
+*/
+struct ColorTableEntry {
+    RGBA color;
+    // The COLOR_ENTRY_* flags
+    uint flags;
+};
+
+/*
+    The state of an object in the current frame. This is
+    resolved once per object by resolveObjects.comp, so the
+    vertices of the object only have to fetch it.
+*/
+struct ResolvedObject {
+    // The local transform, rotation and audio scale of the object
+    mat2 transform;
+    vec2 position;
+    float opacity;
+    // Invisible blocks fade their glow differently
+    float glowOpacity;
+    float invisibleBlockFade;
+    uint flags;
+};
+
+/*
+    A sprite of a batch with vertex pulling. The object shader
+    builds the verticies of the sprite from this and the points
+    of its mesh, instead of reading them from a vertex buffer.
+*/
+struct ObjectSprite {
+    // The same as SpriteVertexTransforms, relative to the object unless it is baked
+    vec2 positionBottomLeft;
+    vec2 positionRight;
+    vec2 positionUp;
+    vec2 texCoordBottomLeft;
+    /*
+        The texture coordinate vectors along positionRight and
+        positionUp are (x, 0) and (0, y) of this, or (0, x) and
+        (y, 0) with OBJECT_SPRITE_TEXTURE_ROTATED.
+    */
+    vec2 texCoordSize;
+    uint srbIndex;
+    uint firstMeshPoint;
+    // The same as the colorChannel vertex attribute
+    uint colorChannel;
+    // The sprite sheet, the shader sprite and the OBJECT_SPRITE_* flags
+    uint info;
+};
+
+#define OBJECT_SPRITE_SHEET_MASK         0xff
+#define OBJECT_SPRITE_SHADER_SPRITE_BIT  8
+#define OBJECT_SPRITE_SHADER_SPRITE_MASK 0xff
+#define OBJECT_SPRITE_TEXTURE_ROTATED    (1 << 16)
+#define OBJECT_SPRITE_SHADER_FLIP_X      (1 << 17)
+#define OBJECT_SPRITE_SHADER_FLIP_Y      (1 << 18)
+
+/*
+    With vertex pulling, every index is the index of the sprite
+    shifted by this many bits, plus the index of the mesh point.
+*/
+#define SPRITE_MESH_POINT_BITS 8
+#define SPRITE_MESH_POINT_MASK ((1 << SPRITE_MESH_POINT_BITS) - 1)
+
+/*
+    A chunk of objects in a batch that gets culled as a whole.
+    See ObjectBatchChunk in ObjectBatch.hpp.
+*/
+struct ObjectChunkInfo {
+    vec2 boundsMin;
+    vec2 boundsMax;
+    float extent;
+    uint groupStateLocation;
+    uint firstIndex;
+    uint indexCount;
+    // The index range drawn in the opaque pass of the depth pass
+    uint firstOpaqueIndex;
+    uint opaqueIndexCount;
+    // Index of the draw list (and its draw count) this chunk belongs to
+    uint drawListIndex;
+    // Index of this chunk's draw command inside of its draw list
+    uint indexInDrawList;
+    uint drawListChunkCount;
+};
+
+/*
+    The layout OpenGL expects for the commands
+    of glMultiDrawElementsIndirect.
+*/
+struct DrawElementsIndirectCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int  baseVertex;
+    uint baseInstance;
+};
+
+// Extra space around the camera in which chunks are still drawn
+#define CHUNK_CULLING_MARGIN 30.0
+
+#define CHUNK_CULLING_GROUP_SIZE 64
+
+#define OBJECT_RESOLVE_GROUP_SIZE 64
+
+// Vertices with a lower opacity than this are not drawn
+#define MIN_VISIBLE_OPACITY 0.01
+
 /*
     This contains a crop rectangle of a sprite
     in a spritesheet.
@@ -181,25 +320,49 @@ struct SpriteCrop {
 #define DYNAMIC_RENDERING_BUFFER_BINDING 0
 #define STATIC_RENDERING_BUFFER_BINDING  1
 #define RENDERER_UNIFORM_BUFFER_BINDING  2
-//#define SPRITE_CROP_BUFFER_BINDING       3
+#define COLOR_TABLE_BUFFER_BINDING       3
+#define OBJECT_CHUNK_BUFFER_BINDING      4
+#define DRAW_COMMAND_BUFFER_BINDING      5
+#define DRAW_COUNT_BUFFER_BINDING        6
+#define RESOLVED_OBJECT_BUFFER_BINDING   7
+#define OBJECT_SPRITE_BUFFER_BINDING     8
+#define SPRITE_MESH_POINT_BUFFER_BINDING 9
 
 /*
     This is the dynamic rendering buffer. This
     is the buffer that contains the required
     rendering information that has to change
-    almost every frame. Stuff like the color
-    channel colors and group transforms.
+    almost every frame, the packed group
+    combination states (see GROUP_STATE_IS_AFFINE).
+
+    The words are stored as uvec4s, so the layout is the
+    same under std140 and std430. When the states fit in a
+    uniform block, it is bound as a uniform buffer instead,
+    which some drivers read through a faster cache.
+
+    The renderer passes DRB_UNIFORM_BUFFER_SIZE, which is
+    GL_MAX_UNIFORM_BLOCK_SIZE clamped to these bounds. OpenGL
+    allows at least 16 KiB. benchmarks/drbBinding.cpp found
+    the uniform buffer as fast or faster at every size up to
+    64 KiB on llvmpipe, so nothing larger is used until it
+    has been measured.
 */
-STORAGE_BUFFER(DYNAMIC_RENDERING_BUFFER_BINDING) DynamicRenderingBuffer {
-    RGBA channelColors[COLOR_CHANNEL_COUNT];
-    /*
-        Bitmap for whether the color channels
-        have blending enabled.
-    */
-    uint colorChannelBlendingBitmap[COLOR_CHANNEL_COUNT / 32 + 1];
+#define DRB_MIN_UNIFORM_BUFFER_SIZE 16384
+#define DRB_MAX_UNIFORM_BUFFER_SIZE 65536
 
-    GroupCombinationState groupCombinationStates[CPP_ONLY(0)];
+#if defined(GLSL) && defined(DRB_UNIFORM_BUFFER)
+#ifndef DRB_UNIFORM_BUFFER_SIZE
+#define DRB_UNIFORM_BUFFER_SIZE DRB_MIN_UNIFORM_BUFFER_SIZE
+#endif
+
+UNIFORM_BUFFER(DYNAMIC_RENDERING_BUFFER_BINDING) DynamicRenderingBuffer {
+    uvec4 groupStates[DRB_UNIFORM_BUFFER_SIZE / 16];
+} drb;
+#else
+STORAGE_BUFFER(DYNAMIC_RENDERING_BUFFER_BINDING) DynamicRenderingBuffer {
+    uvec4 groupStates[CPP_ONLY(0)];
 } GLSL_ONLY(drb);
+#endif
 
 /*
     This is the static rendering buffer. This is the
@@ -211,6 +374,33 @@ STORAGE_BUFFER(STATIC_RENDERING_BUFFER_BINDING) StaticRenderingBuffer {
     StaticObjectInfo objects[CPP_ONLY(0)];
 } GLSL_ONLY(srb);
 
+/*
+    This contains the entries of the color table.
+*/
+STORAGE_BUFFER(COLOR_TABLE_BUFFER_BINDING) ColorTableBuffer {
+    ColorTableEntry colorTable[CPP_ONLY(0)];
+} GLSL_ONLY(ctb);
+
+/*
+    This contains the state of every object in the
+    current frame, written by resolveObjects.comp.
+*/
+STORAGE_BUFFER(RESOLVED_OBJECT_BUFFER_BINDING) ResolvedObjectBuffer {
+    ResolvedObject resolvedObjects[CPP_ONLY(0)];
+} GLSL_ONLY(rob);
+
+/*
+    These contain the sprites of a batch and the points of
+    their meshes, when vertex pulling is used.
+*/
+STORAGE_BUFFER(OBJECT_SPRITE_BUFFER_BINDING) ObjectSpriteBuffer {
+    ObjectSprite sprites[CPP_ONLY(0)];
+} GLSL_ONLY(osb);
+
+STORAGE_BUFFER(SPRITE_MESH_POINT_BUFFER_BINDING) SpriteMeshPointBuffer {
+    vec2 meshPoints[CPP_ONLY(0)];
+} GLSL_ONLY(mpb);
+
 /*
     This contains a list of all sprite crops needed in
     rendering. Every sprite to be drawn is passed with
@@ -238,8 +428,13 @@ UNIFORM_BUFFER(RENDERER_UNIFORM_BUFFER_BINDING) RendererUniformBuffer {
     float u_screenRight;
     float u_cameraUnzoomedX;
     vec3  u_specialLightBGColor;
+    // The color the glow of invisible blocks fades to
+    vec3  u_invisibleBlockGlowColor;
 
     uint  u_gameStateFlags;
+
+    // Depth step between two vertices in draw order, used by the depth pass
+    float u_depthScale;
 };
 
 /*
@@ -257,6 +452,38 @@ UNIFORM_BUFFER(RENDERER_UNIFORM_BUFFER_BINDING) RendererUniformBuffer {
 #define SHADER_SPRITE_GRADIENT_RADIAL 4
 #define SHADER_SPRITE_GRADIENT_RADIAL_CORNER 5
 
+#ifdef GLSL
+#define DRB_WORD(I) ( drb.groupStates[(I) >> 2][(I) & 3] )
+
+// Unpacks a state from the DRB, see GROUP_STATE_IS_AFFINE
+GroupCombinationState getGroupCombinationState(uint location) {
+    uint offset = location & GROUP_STATE_OFFSET_MASK;
+
+    GroupCombinationState state;
+    state.positionalTransform = mat2(1.0);
+    state.localTransform      = mat2(1.0);
+
+    if ((location & GROUP_STATE_IS_AFFINE) != 0) {
+        state.positionalTransform = mat2(
+            uintBitsToFloat(DRB_WORD(offset + 0)), uintBitsToFloat(DRB_WORD(offset + 1)),
+            uintBitsToFloat(DRB_WORD(offset + 2)), uintBitsToFloat(DRB_WORD(offset + 3))
+        );
+        state.localTransform = mat2(
+            uintBitsToFloat(DRB_WORD(offset + 4)), uintBitsToFloat(DRB_WORD(offset + 5)),
+            uintBitsToFloat(DRB_WORD(offset + 6)), uintBitsToFloat(DRB_WORD(offset + 7))
+        );
+        offset += 8;
+    }
+
+    state.offset = vec2(
+        uintBitsToFloat(DRB_WORD(offset + 0)),
+        uintBitsToFloat(DRB_WORD(offset + 1))
+    );
+    state.opacity = unpackHalf2x16(DRB_WORD(offset + 2)).x;
+    return state;
+}
+#endif
+
 #ifndef GLSL
 // Remove the changed alignments
 #undef vec2
@@ -265,6 +492,7 @@ UNIFORM_BUFFER(RENDERER_UNIFORM_BUFFER_BINDING) RendererUniformBuffer {
 #undef mat2
 #undef mat3
 #undef mat4
+#undef uvec4
 #undef bool
 #undef uint
 #undef HSV
@@ -2,6 +2,8 @@
 #include "Geode/cocos/CCDirector.h"
 #include "Geode/cocos/platform/win32/CCGL.h"
 #include "renderer/Buffer.hpp"
+#include <algorithm>
+#include <cmath>
 
 using namespace geode::prelude;
 
@@ -66,4 +68,22 @@ std::optional<std::string> readResourceFile(const fs::path& path) {
     t.close();
 
     return buffer;
-}
\ No newline at end of file
+}
+
+SampleStats getSampleStats(std::vector<u64>& samples) {
+    if (samples.empty())
+        return {};
+
+    std::sort(samples.begin(), samples.end());
+
+    auto percentile = [&](double p) {
+        usize rank = (usize)std::ceil(p * samples.size());
+        return samples[std::clamp<usize>(rank, 1, samples.size()) - 1];
+    };
+
+    double total = 0.0;
+    for (auto sample : samples)
+        total += sample;
+
+    return { total / samples.size(), percentile(0.50), percentile(0.95), percentile(0.99), samples.back() };
+}
@@ -83,6 +83,14 @@ void drawFullscreenQuad();
 
 std::optional<std::string> readResourceFile(const fs::path& path);
 
+struct SampleStats {
+    double mean;
+    u64 p50, p95, p99, max;
+};
+
+// Nearest-rank percentiles of the samples. Sorts the samples
+SampleStats getSampleStats(std::vector<u64>& samples);
+
 inline glm::vec2 getClockwise(const glm::vec2& v) {
     return { v.y, -v.x };
 }
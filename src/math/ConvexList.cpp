@@ -3,4 +3,28 @@
 void ConvexList::triangulate(TriangleCallback callback) const {
     for (const auto& polygon : polygons)
         polygon.triangulate(callback);
-}
\ No newline at end of file
+}
+
+ConvexList ConvexList::subtract(const ConvexPolygon& polygon) const {
+    ConvexList result;
+
+    for (const auto& part : polygons) {
+        if (!part.overlaps(polygon)) {
+            result.addPolygon(part);
+            continue;
+        }
+
+        for (const auto& remainder : part.subtract(polygon))
+            result.addPolygon(remainder);
+    }
+
+    return result;
+}
+
+bool ConvexList::overlaps(const ConvexPolygon& polygon) const {
+    for (const auto& part : polygons) {
+        if (part.overlaps(polygon))
+            return true;
+    }
+    return false;
+}
@@ -8,8 +8,19 @@ public:
         polygons.push_back(polygon);
     }
 
+    inline std::span<const ConvexPolygon> getPolygons() const {
+        return polygons;
+    }
+
+    inline bool isEmpty() const { return polygons.empty(); }
+
     void triangulate(TriangleCallback callback) const;
 
+    // Returns the parts of this list that are not inside of the polygon
+    ConvexList subtract(const ConvexPolygon& polygon) const;
+
+    bool overlaps(const ConvexPolygon& polygon) const;
+
 private:
     std::vector<ConvexPolygon> polygons;
 };
\ No newline at end of file
@@ -4,6 +4,30 @@
 
 using namespace geode::prelude;
 
+// Parts of a polygon smaller than this are dropped
+#define MIN_POLYGON_AREA 0.000001
+
+ConvexPolygon ConvexPolygon::fromPoints(std::span<const glm::vec2> points) {
+    ConvexPolygon polygon;
+
+    for (isize i = 0; i < points.size(); i++) {
+        isize nextI = i + 1;
+        if (nextI >= points.size()) nextI = 0;
+
+        glm::vec2 p1 = points[i];
+        glm::vec2 p2 = points[nextI];
+
+        // A line needs a direction
+        if (glm::length(p2 - p1) < EPSILON)
+            continue;
+
+        auto line = Line { p1, getClockwise(p2 - p1) };
+        polygon.addLine(line);
+    }
+
+    return polygon;
+}
+
 bool ConvexPolygon::containsPoint(const glm::vec2& point) const {
     for (const Line& line : lines) {
         if (line.isPointInFront(point))
@@ -131,4 +155,113 @@ void ConvexPolygon::triangulate(TriangleCallback callback) const {
         callback(point, firstPoint, prevPoint);
         prevPoint = point;
     }
+}
+
+std::vector<glm::vec2> ConvexPolygon::getPoints() const {
+    std::vector<glm::vec2> points;
+    if (lines.size() <= 2)
+        return points;
+
+    for (isize i = 0; i < lines.size(); i++) {
+        std::optional<glm::vec2> point = lines[i].intersectionWith(lines[nextIndex(i)]);
+        if (point)
+            points.push_back(point.value());
+    }
+
+    return points;
+}
+
+ConvexPolygon ConvexPolygon::transformed(const glm::mat2& matrix, const glm::vec2& offset) const {
+    std::vector<glm::vec2> points = getPoints();
+    for (auto& point : points)
+        point = matrix * point + offset;
+
+    // A mirroring transform turns the points clockwise
+    if (glm::determinant(matrix) < 0)
+        std::reverse(points.begin(), points.end());
+
+    return fromPoints(points);
+}
+
+static bool isPolygonInFrontOfAnyLine(const std::vector<glm::vec2>& points, std::span<const Line> lines) {
+    for (const Line& line : lines) {
+        bool allInFront = true;
+        for (const auto& point : points) {
+            if (glm::dot(point, line.normal) < line.distance - EPSILON) {
+                allInFront = false;
+                break;
+            }
+        }
+
+        if (allInFront)
+            return true;
+    }
+    return false;
+}
+
+// Two convex polygons don't overlap when one is fully in front of a line of the other
+bool ConvexPolygon::overlaps(const ConvexPolygon& other) const {
+    std::vector<glm::vec2> points      = getPoints();
+    std::vector<glm::vec2> otherPoints = other.getPoints();
+
+    if (points.size() < 3 || otherPoints.size() < 3)
+        return false;
+
+    return !isPolygonInFrontOfAnyLine(points, other.lines) &&
+           !isPolygonInFrontOfAnyLine(otherPoints, lines);
+}
+
+// Keeps the part of the polygon behind the line (Sutherland-Hodgman)
+static std::vector<glm::vec2> clipPointsBehindLine(const std::vector<glm::vec2>& points, const Line& line) {
+    std::vector<glm::vec2> result;
+
+    for (isize i = 0; i < points.size(); i++) {
+        const glm::vec2& p1 = points[i];
+        const glm::vec2& p2 = points[(i + 1) % points.size()];
+
+        float d1 = glm::dot(p1, line.normal) - line.distance;
+        float d2 = glm::dot(p2, line.normal) - line.distance;
+
+        if (d1 <= 0)
+            result.push_back(p1);
+
+        if ((d1 < 0 && d2 > 0) || (d1 > 0 && d2 < 0))
+            result.push_back(p1 + (p2 - p1) * (d1 / (d1 - d2)));
+    }
+
+    return result;
+}
+
+static float getPolygonArea(const std::vector<glm::vec2>& points) {
+    float area = 0;
+    for (isize i = 0; i < points.size(); i++) {
+        const glm::vec2& p1 = points[i];
+        const glm::vec2& p2 = points[(i + 1) % points.size()];
+        area += p1.x * p2.y - p2.x * p1.y;
+    }
+    return area * 0.5f;
+}
+
+std::vector<ConvexPolygon> ConvexPolygon::subtract(const ConvexPolygon& other) const {
+    std::vector<ConvexPolygon> parts;
+    std::vector<glm::vec2> inside = getPoints();
+
+    /*
+        Every line of the other polygon splits off the part that
+        is in front of it. What is left after all lines is inside
+        of the other polygon.
+    */
+    for (const Line& line : other.lines) {
+        Line flipped { -line.distance, -line.normal };
+
+        std::vector<glm::vec2> outside = clipPointsBehindLine(inside, flipped);
+        if (outside.size() >= 3 && getPolygonArea(outside) > MIN_POLYGON_AREA)
+            parts.push_back(fromPoints(outside));
+
+        inside = clipPointsBehindLine(inside, line);
+        if (inside.size() < 3)
+            break;
+    }
+
+    return parts;
 }
\ No newline at end of file
@@ -15,6 +15,9 @@ using TriangleCallback = std::function<void(const glm::vec2&, const glm::vec2&,
 */
 class ConvexPolygon {
 public:
+    // The points have to be counter clockwise
+    static ConvexPolygon fromPoints(std::span<const glm::vec2> points);
+
     bool containsPoint(const glm::vec2& point) const;
 
     void addLine(const Line& line);
@@ -29,6 +32,21 @@ public:
 
     void triangulate(TriangleCallback callback) const;
 
+    // Returns the corners of the polygon, counter clockwise
+    std::vector<glm::vec2> getPoints() const;
+
+    // Returns this polygon with every point p transformed to (matrix * p + offset)
+    ConvexPolygon transformed(const glm::mat2& matrix, const glm::vec2& offset) const;
+
+    bool overlaps(const ConvexPolygon& other) const;
+
+    /*
+        Returns the parts of this polygon that are not inside of
+        the other polygon. There is at most one part per line of
+        the other polygon.
+    */
+    std::vector<ConvexPolygon> subtract(const ConvexPolygon& other) const;
+
     inline isize nextIndex(isize index) const {
         index++;
         if (index >= lines.size()) return 0;
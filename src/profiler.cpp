@@ -1,5 +1,10 @@
 #include <Geode/Geode.hpp>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "Geode/cocos/CCDirector.h"
 #include "common.hpp"
@@ -12,18 +17,304 @@
 #include <Geode/modify/LevelEditorLayer.hpp>
 #include <Geode/modify/CCSprite.hpp>
 
+enum class TraceEventType : u8 {
+    BEGIN,
+    END
+};
+
+struct TraceEvent {
+    const char* name;
+    u64 time;
+    TraceEventType type;
+};
+
+// Has to be a power of two
+static constexpr usize TRACE_BUFFER_SIZE = 1 << 20;
+
+/*
+    Only the thread owning the buffer writes to it, so recording
+    an event doesn't need a lock. When the buffer is full, the
+    oldest events get overwritten.
+*/
+struct TraceBuffer {
+    std::vector<TraceEvent> events;
+    std::atomic<u64> eventCount = 0;
+    // The first event of the current trace
+    u64 traceBegin = 0;
+    u32 threadId;
+
+    inline void push(const char* name, TraceEventType type) {
+        u64 index = eventCount.load(std::memory_order_relaxed);
+        events[index & (TRACE_BUFFER_SIZE - 1)] = { name, getTime(), type };
+        eventCount.store(index + 1, std::memory_order_release);
+    }
+
+    inline u64 getFirstEvent(u64 end) const {
+        return end > TRACE_BUFFER_SIZE ? end - TRACE_BUFFER_SIZE : 0;
+    }
+
+    inline const TraceEvent& operator[](u64 index) const {
+        return events[index & (TRACE_BUFFER_SIZE - 1)];
+    }
+};
+
+static std::mutex traceBuffersMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+
+static std::atomic<bool> isRecording = false;
+static bool isTracingFrames = false;
+static bool isCapturing = false;
+
 bool takeSnapshotNextFrame = false;
 bool isTakingSnapshot      = false;
+// The GPU time of the snapshot is read once it is ready, so the CPU doesn't wait for it
+bool isSnapshotGPUTimePending = false;
+
+// Only locks the first time a thread records an event
+static TraceBuffer& getThreadTraceBuffer() {
+    thread_local TraceBuffer* buffer = nullptr;
+    if (buffer)
+        return *buffer;
+
+    std::lock_guard lock(traceBuffersMutex);
+    auto newBuffer = std::make_unique<TraceBuffer>();
+    newBuffer->events.resize(TRACE_BUFFER_SIZE);
+    newBuffer->threadId = traceBuffers.size();
+
+    buffer = newBuffer.get();
+    traceBuffers.push_back(std::move(newBuffer));
+    return *buffer;
+}
+
+static void updateRecording() {
+    isRecording.store(isTakingSnapshot || isTracingFrames || isCapturing, std::memory_order_relaxed);
+}
+
+// Logs the self time of every function called between the two events
+static void logSnapshot(const TraceBuffer& buffer, u64 begin, u64 end) {
+    std::unordered_map<const char*, i64> timeSpentInFunction;
+    std::vector<const char*> functionCallStack;
+
+    begin = std::max(begin, buffer.getFirstEvent(end));
+    if (begin >= end)
+        return;
+
+    u64 lastEventTime = buffer[begin].time;
+    for (u64 i = begin; i < end; i++) {
+        auto& event = buffer[i];
+
+        if (!functionCallStack.empty())
+            timeSpentInFunction[functionCallStack.back()] += event.time - lastEventTime;
+        lastEventTime = event.time;
+
+        if (event.type == TraceEventType::BEGIN)
+            functionCallStack.push_back(event.name);
+        else if (!functionCallStack.empty())
+            functionCallStack.pop_back();
+    }
+
+    std::vector<std::pair<const char*, i64>> functionsTime(timeSpentInFunction.begin(), timeSpentInFunction.end());
+    std::sort(
+        functionsTime.begin(),
+        functionsTime.end(),
+        [&](const std::pair<const char*, i64>& a, const std::pair<const char*, i64>& b) {
+            return a.second < b.second;
+        }
+    );
+
+    for (auto [name, time] : functionsTime)
+        geode::log::info("- {} : {}ms", name, (double)time / 1000000.0);
+}
+
+//// CAPTURE ////
+
+/*
+    A capture records every call of every hooked function over
+    many frames. The events are turned into samples at the end
+    of every frame, so a capture isn't limited by the size of
+    the ring buffers, only each frame is.
+*/
 
-std::unordered_map<void*, i64> timeSpentInFunction;
+struct FunctionSamples {
+    std::vector<u64> inclusiveTimes;
+    std::vector<u64> selfTimes;
+};
+
+struct OpenCall {
+    const char* name;
+    u64 beginTime;
+    u64 childTime;
+};
+
+struct CaptureThreadState {
+    u64 processedEvents;
+    std::vector<OpenCall> callStack;
+};
+
+// The frame time histogram has a bucket per millisecond up to this
+static constexpr usize FRAME_HISTOGRAM_BUCKETS = 50;
+
+static struct {
+    u32 framesLeft;
+    u64 endTime;
+    std::unordered_map<const char*, FunctionSamples> functions;
+    std::unordered_map<TraceBuffer*, CaptureThreadState> threads;
+    std::vector<u64> frameTimes;
+} capture;
+
+static void startCapture() {
+    capture.framesLeft = geode::Mod::get()->getSettingValue<int64_t>("profiler_capture_frames");
+    capture.endTime    = 0;
+
+    double seconds = geode::Mod::get()->getSettingValue<double>("profiler_capture_seconds");
+    if (seconds > 0.0)
+        capture.endTime = getTime() + (u64)(seconds * 1000000000.0);
+
+    capture.functions.clear();
+    capture.threads.clear();
+    capture.frameTimes.clear();
+
+    {
+        std::lock_guard lock(traceBuffersMutex);
+        for (auto& buffer : traceBuffers)
+            capture.threads[buffer.get()] = { buffer->eventCount.load(std::memory_order_acquire), {} };
+    }
+
+    isCapturing = true;
+    updateRecording();
+
+    if (capture.endTime != 0)
+        geode::log::info("Started profiler capture of {}s", seconds);
+    else
+        geode::log::info("Started profiler capture of {} frame(s)", capture.framesLeft);
+}
+
+// Turns the events recorded since the last call into samples
+static void processCaptureEvents() {
+    std::lock_guard lock(traceBuffersMutex);
 
-i64 lastFunctionTime;
-std::vector<void*> functionCallStack;
+    for (auto& buffer : traceBuffers) {
+        // Threads that started recording during the capture have all their events in it
+        auto& thread = capture.threads[buffer.get()];
+
+        u64 end   = buffer->eventCount.load(std::memory_order_acquire);
+        u64 begin = std::max(thread.processedEvents, buffer->getFirstEvent(end));
+        if (begin != thread.processedEvents) {
+            geode::log::warn("Profiler capture lost {} event(s) of a frame", begin - thread.processedEvents);
+            thread.callStack.clear();
+        }
+
+        for (u64 i = begin; i < end; i++) {
+            auto& event = (*buffer)[i];
+
+            if (event.type == TraceEventType::BEGIN) {
+                thread.callStack.push_back({ event.name, event.time, 0 });
+                continue;
+            }
+            if (thread.callStack.empty())
+                continue;
+
+            auto call = thread.callStack.back();
+            thread.callStack.pop_back();
+
+            u64 inclusiveTime = event.time - call.beginTime;
+            if (!thread.callStack.empty())
+                thread.callStack.back().childTime += inclusiveTime;
+
+            auto& samples = capture.functions[call.name];
+            samples.inclusiveTimes.push_back(inclusiveTime);
+            samples.selfTimes.push_back(inclusiveTime - std::min(call.childTime, inclusiveTime));
+        }
+
+        thread.processedEvents = end;
+    }
+}
+
+static std::string formatStats(const SampleStats& stats) {
+    auto ms = [](double time) { return time / 1000000.0; };
+    return fmt::format(
+        "{:.4f},{:.4f},{:.4f},{:.4f},{:.4f}",
+        ms(stats.mean), ms(stats.p50), ms(stats.p95), ms(stats.p99), ms(stats.max)
+    );
+}
+
+static bool writeCaptureFunctions(const std::filesystem::path& path) {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    file << "function,calls,"
+            "inclusive_mean_ms,inclusive_p50_ms,inclusive_p95_ms,inclusive_p99_ms,inclusive_max_ms,"
+            "self_mean_ms,self_p50_ms,self_p95_ms,self_p99_ms,self_max_ms\n";
+
+    for (auto& [name, samples] : capture.functions) {
+        usize calls = samples.inclusiveTimes.size();
+        auto inclusiveStats = getSampleStats(samples.inclusiveTimes);
+        auto selfStats      = getSampleStats(samples.selfTimes);
+
+        file << fmt::format("\"{}\",{},{},{}\n", name, calls, formatStats(inclusiveStats), formatStats(selfStats));
+    }
+    return file.good();
+}
+
+static bool writeCaptureFrames(const std::filesystem::path& path) {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    std::array<u32, FRAME_HISTOGRAM_BUCKETS + 1> histogram {};
+    for (auto time : capture.frameTimes)
+        histogram[std::min<usize>(time / 1000000, FRAME_HISTOGRAM_BUCKETS)]++;
+
+    file << "frame_time_ms,frames\n";
+    for (usize i = 0; i < FRAME_HISTOGRAM_BUCKETS; i++)
+        file << fmt::format("{}-{},{}\n", i, i + 1, histogram[i]);
+    file << fmt::format("{}+,{}\n", FRAME_HISTOGRAM_BUCKETS, histogram[FRAME_HISTOGRAM_BUCKETS]);
+    return file.good();
+}
+
+static void finishCapture() {
+    isCapturing = false;
+    updateRecording();
+    processCaptureEvents();
+
+    auto frameStats = getSampleStats(capture.frameTimes);
+    geode::log::info(
+        "Profiler capture of {} frame(s), frame time (ms): mean {:.2f}, p50 {:.2f}, p95 {:.2f}, p99 {:.2f}, max {:.2f}",
+        capture.frameTimes.size(), frameStats.mean / 1000000.0, frameStats.p50 / 1000000.0,
+        frameStats.p95 / 1000000.0, frameStats.p99 / 1000000.0, frameStats.max / 1000000.0
+    );
+
+    auto prefix = geode::Mod::get()->getSaveDir() / fmt::format("capture-{}", std::time(nullptr));
+    auto functionsPath = prefix.string() + "-functions.csv";
+    auto framesPath    = prefix.string() + "-frames.csv";
+
+    if (writeCaptureFunctions(functionsPath) && writeCaptureFrames(framesPath))
+        geode::log::info("Wrote profiler capture to {} and {}", functionsPath, framesPath);
+    else
+        geode::log::error("Failed to write profiler capture to {}", prefix.string());
+
+    capture.functions.clear();
+    capture.threads.clear();
+    capture.frameTimes.clear();
+}
 
 class $modify(MyCCKeyboardDispatcher, cocos2d::CCKeyboardDispatcher) {
     bool dispatchKeyboardMSG(cocos2d::enumKeyCodes key, bool keyDown, bool p3) {
         if (keyDown && key == cocos2d::KEY_P)
             takeSnapshotNextFrame = true;
+        if (keyDown && key == cocos2d::KEY_I && !p3) {
+            if (isCapturing)
+                finishCapture();
+            else
+                startCapture();
+        }
+        if (keyDown && key == cocos2d::KEY_O && !p3) {
+            if (profiler::isTracing())
+                profiler::stopTrace();
+            else
+                profiler::startTrace();
+        }
         if (keyDown && key == cocos2d::KEY_F10) {
             cocos2d::CCDirector::get()->getRunningScene()->setVisible(!cocos2d::CCDirector::get()->getRunningScene()->isVisible());
         }
@@ -35,80 +326,216 @@ class $modify(MyCCKeyboardDispatcher, cocos2d::CCKeyboardDispatcher) {
 class $modify(MyCCDisplayLinkDirector, cocos2d::CCDisplayLinkDirector) {
     void mainLoop() {
         u64 processTime = 0;
+        u64 snapshotBegin = 0;
+        u64 frameBeginTime = getTime();
+
+        if (isSnapshotGPUTimePending) {
+            GLint available = 0;
+            glGetQueryObjectiv(1, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                i64 gpuTime = 0;
+                glGetQueryObjecti64v(1, GL_QUERY_RESULT, &gpuTime);
+                geode::log::info("Rendering time: {}ms", (double)gpuTime / 1000000.0);
+                isSnapshotGPUTimePending = false;
+            }
+        }
 
-        if (takeSnapshotNextFrame) {
+        if (takeSnapshotNextFrame && !isSnapshotGPUTimePending) {
             isTakingSnapshot = true;
             takeSnapshotNextFrame = false;
-            timeSpentInFunction.clear();
+            updateRecording();
             glBeginQuery(GL_TIME_ELAPSED, 1);
             processTime = getTime();
+            snapshotBegin = getThreadTraceBuffer().eventCount.load(std::memory_order_relaxed);
         }
 
         CCDisplayLinkDirector::mainLoop();
         
         if (isTakingSnapshot) {
             isTakingSnapshot = false;
+            updateRecording();
 
             processTime = getTime() - processTime;
 
-            i64 gpuTime = 0;
             glEndQuery(GL_TIME_ELAPSED);
-            glGetQueryObjecti64v(1, GL_QUERY_RESULT, &gpuTime);
-
-            std::vector<std::pair<void*, i64>> functionsTime;
-            for (auto pair : timeSpentInFunction)
-                functionsTime.push_back(pair);
-                
-            std::sort(
-                functionsTime.begin(),
-                functionsTime.end(),
-                [&](const std::pair<void*, i64>& a, const std::pair<void*, i64>& b) {
-                    return a.second < b.second;
-                }
-            );
-        
-            for (auto [name, time] : functionsTime)
-                geode::log::info("- {} : {}ms", (const char*)name, (double)time / 1000000.0);
+            isSnapshotGPUTimePending = true;
+
+            auto& buffer = getThreadTraceBuffer();
+            logSnapshot(buffer, snapshotBegin, buffer.eventCount.load(std::memory_order_relaxed));
 
-            geode::log::info("Rendering time: {}ms", (double)gpuTime / 1000000.0);
             geode::log::info("Processing time: {}ms", (double)processTime / 1000000.0);
         }
+
+        if (isCapturing) {
+            capture.frameTimes.push_back(getTime() - frameBeginTime);
+            processCaptureEvents();
+
+            bool isDone = capture.endTime != 0 ? getTime() >= capture.endTime : --capture.framesLeft == 0;
+            if (isDone)
+                finishCapture();
+        }
     }
 };
 
-static void addToFunctionTime(void* name, u64 time) {
-    if (timeSpentInFunction.find(name) == timeSpentInFunction.end())
-        timeSpentInFunction[name] = time;
-    else
-        timeSpentInFunction[name] += time;
+/*
+    Writes the events of every thread in the Chrome trace event
+    format. Events whose begin was already overwritten are left
+    out, and functions still running get ended at the last event.
+*/
+static bool writeChromeTrace(const std::filesystem::path& path) {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+
+    std::lock_guard lock(traceBuffersMutex);
+    for (auto& buffer : traceBuffers) {
+        u64 end   = buffer->eventCount.load(std::memory_order_acquire);
+        u64 begin = std::max(buffer->traceBegin, buffer->getFirstEvent(end));
+
+        std::vector<const char*> openFunctions;
+        u64 lastEventTime = 0;
+
+        auto writeEvent = [&](const char* name, u64 time, char phase) {
+            file << (first ? "" : ",\n") << fmt::format(
+                "{{\"name\":\"{}\",\"ph\":\"{}\",\"ts\":{:.3f},\"pid\":0,\"tid\":{}}}",
+                name, phase, (double)time / 1000.0, buffer->threadId
+            );
+            first = false;
+        };
+
+        for (u64 i = begin; i < end; i++) {
+            auto& event = (*buffer)[i];
+            lastEventTime = event.time;
+
+            if (event.type == TraceEventType::BEGIN) {
+                openFunctions.push_back(event.name);
+                writeEvent(event.name, event.time, 'B');
+            } else if (!openFunctions.empty()) {
+                openFunctions.pop_back();
+                writeEvent(event.name, event.time, 'E');
+            }
+        }
+
+        while (!openFunctions.empty()) {
+            writeEvent(openFunctions.back(), lastEventTime, 'E');
+            openFunctions.pop_back();
+        }
+    }
+
+    file << "\n]}\n";
+    return file.good();
 }
 
 namespace profiler {
 
 void functionPush(const char* name) {
-    auto time = getTime();
-    if (!isTakingSnapshot)
+    if (!isRecording.load(std::memory_order_relaxed))
         return;
-    
-    if (!functionCallStack.empty()) 
-        addToFunctionTime(functionCallStack.back(), time - lastFunctionTime);
-    
-    functionCallStack.push_back((void*)name);
-    lastFunctionTime = getTime();
+
+    getThreadTraceBuffer().push(name, TraceEventType::BEGIN);
 }
 
 void functionPop(const char* name) {
-    auto time = getTime();
-    if (!isTakingSnapshot)
+    if (!isRecording.load(std::memory_order_relaxed))
         return;
-    
-    if (!functionCallStack.empty()) 
-        addToFunctionTime(functionCallStack.back(), time - lastFunctionTime);
-    
-    functionCallStack.pop_back();
-    lastFunctionTime = getTime();
+
+    getThreadTraceBuffer().push(name, TraceEventType::END);
+}
+
+void startTrace() {
+    // Only the events of this trace get written
+    {
+        std::lock_guard lock(traceBuffersMutex);
+        for (auto& buffer : traceBuffers)
+            buffer->traceBegin = buffer->eventCount.load(std::memory_order_acquire);
+    }
+
+    isTracingFrames = true;
+    updateRecording();
+    geode::log::info("Started profiler trace");
+}
+
+void stopTrace() {
+    isTracingFrames = false;
+    updateRecording();
+
+    auto path = geode::Mod::get()->getSaveDir() / fmt::format("trace-{}.json", std::time(nullptr));
+    if (writeChromeTrace(path))
+        geode::log::info("Wrote profiler trace to {}", path.string());
+    else
+        geode::log::error("Failed to write profiler trace to {}", path.string());
+}
+
+bool isTracing() {
+    return isTracingFrames;
+}
+
+//// HOOK GROUPS ////
+
+// The hooks of every class, by the class name without namespaces
+static std::unordered_map<std::string, std::vector<geode::Hook*>>& getHookGroups() {
+    static std::unordered_map<std::string, std::vector<geode::Hook*>> hookGroups;
+    return hookGroups;
+}
+
+void addHookToGroup(std::string_view className, geode::Hook* hook) {
+    auto separator = className.rfind("::");
+    if (separator != std::string_view::npos)
+        className = className.substr(separator + 2);
+
+    hook->setAutoEnable(false);
+    getHookGroups()[std::string(className)].push_back(hook);
+}
+
+/*
+    The setting is a comma separated list of class names,
+    or * for every class.
+*/
+static void applyHookGroups(const std::string& setting) {
+    std::unordered_set<std::string> enabledGroups;
+    bool enableAll = false;
+
+    for (auto& group : geode::utils::string::split(setting, ",")) {
+        auto name = geode::utils::string::trim(group);
+        if (name == "*")
+            enableAll = true;
+        else if (!name.empty())
+            enabledGroups.insert(name);
+    }
+
+    usize enabledHookCount = 0;
+    for (auto& [name, hooks] : getHookGroups()) {
+        bool enable = enableAll || enabledGroups.contains(name);
+        enabledGroups.erase(name);
+
+        for (auto hook : hooks) {
+            if (hook->isEnabled() == enable)
+                continue;
+
+            auto result = enable ? hook->enable() : hook->disable();
+            if (result.isErr())
+                geode::log::error("Failed to toggle profiler hook {}: {}", hook->getDisplayName(), result.unwrapErr());
+        }
+        if (enable)
+            enabledHookCount += hooks.size();
+    }
+
+    for (auto& name : enabledGroups)
+        geode::log::warn("There are no profiler hooks for the class {}", name);
+
+    geode::log::info("{} profiler hook(s) enabled", enabledHookCount);
+}
+
 }
 
+$on_mod(Loaded) {
+    profiler::applyHookGroups(geode::Mod::get()->getSettingValue<std::string>("profiler_hook_groups"));
+    geode::listenForSettingChanges("profiler_hook_groups", [](std::string value) {
+        profiler::applyHookGroups(value);
+    });
 }
 
 #include <Geode/modify/CCSprite.hpp>
@@ -1,36 +1,91 @@
 #include <Geode/Geode.hpp>
 #include <Geode/modify/CCTextureAtlas.hpp>
 
+/*
+    Every hooked function records a begin and an end event into
+    a preallocated ring buffer of the calling thread. Nothing is
+    recorded unless a snapshot or a trace is being taken.
+
+    A snapshot (P) logs the self time of every function during
+    one frame. A trace (O to start and stop) keeps recording for
+    as many frames as the ring buffers hold, and is written to
+    the save directory as a Chrome trace, which can be opened
+    in chrome://tracing or ui.perfetto.dev.
+
+    A capture (I) records the set number of frames or seconds
+    and writes the call count and time percentiles of every
+    function, and a frame time histogram, as CSV files to the
+    save directory.
+
+    The hooks in profiler.cpp are grouped by the class they hook,
+    and only the groups listed in the profiler_hook_groups setting
+    are enabled. The hooks of the other groups are not installed at
+    all, so they cost nothing. The generated profilerHooks.cpp in
+    the repository root is not built, so it has no groups.
+*/
+
 namespace profiler {
 
 void functionPush(const char* name);
 
 void functionPop(const char* name);
 
+void startTrace();
+
+// Stops the trace and writes it to the save directory
+void stopTrace();
+
+bool isTracing();
+
+// Hooks start disabled, until their group is enabled by the setting
+void addHookToGroup(std::string_view className, geode::Hook* hook);
+
+template <typename Hooks>
+inline void addHookGroup(std::string_view className, Hooks& hooks) {
+    for (auto& [name, hook] : hooks)
+        addHookToGroup(className, hook.get());
+}
+
 };
 
 #define CM ,
 
-#define PROFILER_HOOK(Ret_, Class_, Name_, InArgs_, PassArgs_) \
-    class GEODE_CRTP2(GEODE_CONCAT(profilerHook, __LINE__), Class_) { \
-            Ret_ Name_(InArgs_) { \
+// A group of hooks of one class, with a PROFILER_FUNCTION for every hooked function
+#define PROFILER_HOOKS_BEGIN(Class_) \
+    class GEODE_CRTP2(GEODE_CONCAT(profilerHooks, __LINE__), Class_) { \
+        static void onModify(auto& self) { \
+            profiler::addHookGroup(#Class_, self.m_hooks); \
+        }
+
+#define PROFILER_HOOKS_END() \
+    };
+
+#define PROFILER_FUNCTION(Ret_, Class_, Name_, InArgs_, PassArgs_) \
+        Ret_ Name_(InArgs_) { \
             const char* name = #Class_ "::" #Name_; \
             profiler::functionPush(name); \
             Ret_ ret = Class_::Name_(PassArgs_); \
             profiler::functionPop(name); \
             return ret; \
-        } \
-    };
+        }
 
-#define PROFILER_HOOK_VOID(Class_, Name_, InArgs_, PassArgs_) \
-    class GEODE_CRTP2(GEODE_CONCAT(profilerHook, __LINE__), Class_) { \
-            void Name_(InArgs_) { \
+#define PROFILER_FUNCTION_VOID(Class_, Name_, InArgs_, PassArgs_) \
+        void Name_(InArgs_) { \
             const char* name = #Class_ "::" #Name_; \
             profiler::functionPush(name); \
             Class_::Name_(PassArgs_); \
             profiler::functionPop(name); \
-        } \
-    };
+        }
+
+#define PROFILER_HOOK(Ret_, Class_, Name_, InArgs_, PassArgs_) \
+    PROFILER_HOOKS_BEGIN(Class_) \
+        PROFILER_FUNCTION(Ret_, Class_, Name_, InArgs_, PassArgs_) \
+    PROFILER_HOOKS_END()
+
+#define PROFILER_HOOK_VOID(Class_, Name_, InArgs_, PassArgs_) \
+    PROFILER_HOOKS_BEGIN(Class_) \
+        PROFILER_FUNCTION_VOID(Class_, Name_, InArgs_, PassArgs_) \
+    PROFILER_HOOKS_END()
 
 #define PROFILER_HOOK_3(Ret_, Class_, Name_) \
     PROFILER_HOOK(Ret_, Class_, Name_, , )
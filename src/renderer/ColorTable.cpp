@@ -0,0 +1,140 @@
+#include "ColorTable.hpp"
+#include "Renderer.hpp"
+
+#include <Geode/binding/GameObject.hpp>
+
+ColorTable::~ColorTable() {
+    if (buffer)
+        Buffer::destroy(buffer);
+}
+
+u32 ColorTable::convertToShaderHSV(const cocos2d::ccHSVValue& hsv) {
+    u32 hue = hsv.h + 256.f;
+    u32 sat = ( hsv.s + (hsv.absoluteSaturation ? 1.0 : 0.0) ) * 127.5f;
+    u32 val = ( hsv.v + (hsv.absoluteBrightness ? 1.0 : 0.0) ) * 127.5f;
+
+    u32 ret = (hue & HSV_HUE_MASK) << HSV_HUE_BIT |
+              (sat & HSV_SAT_MASK) << HSV_SAT_BIT |
+              (val & HSV_VAL_MASK) << HSV_VAL_BIT;
+
+    if (hsv.absoluteSaturation) ret |= HSV_SAT_ADD;
+    if (hsv.absoluteBrightness) ret |= HSV_VAL_ADD;
+    return ret;
+}
+
+bool ColorTable::isHSVAppliedByVertexShader(GameObject* object) {
+    return object->m_isInvisibleBlock || object->m_customGlowColor;
+}
+
+std::optional<u32> ColorTable::getHSVOfSprite(GameObject* object, SpriteType type) {
+    // Every sprite that isn't a detail sprite uses the HSV of the base color
+    auto color = type == SpriteType::DETAIL ? object->m_detailColor : object->m_baseColor;
+    if (!color || !color->m_usesHSV || isHSVAppliedByVertexShader(object))
+        return std::nullopt;
+
+    return convertToShaderHSV(color->m_hsv);
+}
+
+std::optional<u32> ColorTable::addEntry(u32 colorChannel, std::optional<u32> hsv) {
+    u64 key = (u64)colorChannel << 33 | (u64)hsv.has_value() << 32 | hsv.value_or(0);
+
+    auto it = entryIndicies.find(key);
+    if (it != entryIndicies.end())
+        return it->second;
+
+    // The entries with HSV leave room for every color channel
+    if (hsv && hsvEntryCount >= COLOR_TABLE_SIZE - COLOR_CHANNEL_COUNT)
+        return std::nullopt;
+
+    u32 index = entries.size();
+    entries.push_back({ colorChannel, hsv });
+    entryIndicies[key] = index;
+    if (hsv)
+        hsvEntryCount++;
+    return index;
+}
+
+u32 ColorTable::getEntry(u32 colorChannel) {
+    return addEntry(colorChannel, std::nullopt).value();
+}
+
+std::optional<u32> ColorTable::getHSVEntry(u32 colorChannel, u32 hsv) {
+    return addEntry(colorChannel, hsv);
+}
+
+bool ColorTable::prepare() {
+    colors.resize(entries.size());
+
+    // An empty storage buffer can't be bound
+    buffer = Buffer::createDynamicDraw(std::max<usize>(entries.size(), 1) * sizeof(ColorTableEntry));
+    return buffer != nullptr;
+}
+
+//// HSV MATH, THE SAME AS IN object.vert ////
+
+// Credits to sam hocevar for the following two functions
+static glm::vec3 rgb2hsv(glm::vec3 c) {
+    glm::vec4 K = glm::vec4(0.0, -1.0 / 3.0, 2.0 / 3.0, -1.0);
+    glm::vec4 p = glm::mix(glm::vec4(c.b, c.g, K.w, K.z), glm::vec4(c.g, c.b, K.x, K.y), glm::step(c.b, c.g));
+    glm::vec4 q = glm::mix(glm::vec4(p.x, p.y, p.w, c.r), glm::vec4(c.r, p.y, p.z, p.x), glm::step(p.x, c.r));
+    float d = q.x - std::min(q.w, q.y);
+    float e = 1.0e-10;
+    return glm::vec3(std::abs(q.z + (q.w - q.y) / (6.0f * d + e)), d / (q.x + e), q.x);
+}
+
+static glm::vec3 hsv2rgb(glm::vec3 c) {
+    glm::vec4 K = glm::vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
+    glm::vec3 p = glm::abs(glm::fract(glm::vec3(c.x) + glm::vec3(K)) * 6.0f - glm::vec3(K.w));
+    return c.z * glm::mix(glm::vec3(K.x), glm::clamp(p - glm::vec3(K.x), 0.0f, 1.0f), c.y);
+}
+
+static glm::vec3 applyHSV(u32 hsvValue, glm::vec3 color) {
+    float hue = (float)((i32)((hsvValue >> HSV_HUE_BIT) & HSV_HUE_MASK) - 256) / 360.0f;
+    float sat = (float)((hsvValue >> HSV_SAT_BIT) & HSV_SAT_MASK) / 127.5f;
+    float val = (float)((hsvValue >> HSV_VAL_BIT) & HSV_VAL_MASK) / 127.5f;
+
+    glm::vec3 hsv = rgb2hsv(color);
+
+    hsv.x = hsv.x + hue - std::floor(hsv.x + hue);
+
+    if (hsvValue & HSV_SAT_ADD)
+        hsv.y += sat - 1.0f;
+    else
+        hsv.y *= sat;
+
+    if (hsvValue & HSV_VAL_ADD)
+        hsv.z += val - 1.0f;
+    else
+        hsv.z *= val;
+
+    hsv.y = glm::clamp(hsv.y, 0.0f, 1.0f);
+    hsv.z = glm::clamp(hsv.z, 0.0f, 1.0f);
+    return hsv2rgb(hsv);
+}
+
+void ColorTable::update(std::span<const RGBA> channelColors, const std::vector<bool>& channelBlending) {
+    if (entries.empty())
+        return;
+
+    for (usize i = 0; i < entries.size(); i++) {
+        auto& entry = entries[i];
+        auto channelColor = channelColors[entry.colorChannel];
+
+        colors[i].color = channelColor;
+        colors[i].flags = channelBlending[entry.colorChannel] ? COLOR_ENTRY_BLENDING : 0;
+
+        if (entry.hsv) {
+            glm::vec3 rgb = applyHSV(entry.hsv.value(), glm::vec3(channelColor.r, channelColor.g, channelColor.b) / 255.0f);
+            rgb = glm::round(glm::clamp(rgb, 0.0f, 1.0f) * 255.0f);
+
+            colors[i].color  = { (u8)rgb.r, (u8)rgb.g, (u8)rgb.b, channelColor.a };
+            colors[i].flags |= COLOR_ENTRY_HSV_APPLIED;
+        }
+    }
+
+    buffer->write(colors.data(), colors.size() * sizeof(ColorTableEntry));
+}
+
+void ColorTable::bind() {
+    buffer->bindAsStorageBuffer(COLOR_TABLE_BUFFER_BINDING);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <common.hpp>
+#include <map>
+#include <optional>
+#include <span>
+#include "Buffer.hpp"
+#include "ObjectSpriteUnpacker.hpp"
+#include "../../resources/shaders/shared.h"
+
+/*
+    A level only uses a few dozen of its 1101 color channels,
+    and only a few hundred different pairs of a color channel
+    and an HSV value.
+
+    So every color channel and every such pair used by a sprite
+    gets an entry in this table when the batches are generated,
+    and the sprites are written with the index of their entry
+    instead of their color channel. The CPU then resolves the
+    color of every entry once per frame, applying the HSV value
+    if it has one, and only the entries are uploaded.
+
+    The vertex shader still applies HSV itself for objects that
+    change their color before HSV is applied (invisible blocks
+    and special glow colors), and when the table is full. Those
+    sprites use the entry of their color channel without HSV.
+*/
+
+class Renderer;
+
+class ColorTable {
+public:
+    ~ColorTable();
+    inline ColorTable(Renderer& renderer)
+        : renderer(renderer) {}
+
+    // Converts the HSV value to the packed format of the shaders
+    static u32 convertToShaderHSV(const cocos2d::ccHSVValue& hsv);
+
+    /*
+        The shader HSV value of the sprite, or nullopt when
+        it has no HSV or the vertex shader has to apply it.
+    */
+    static std::optional<u32> getHSVOfSprite(GameObject* object, SpriteType type);
+
+    static bool isHSVAppliedByVertexShader(GameObject* object);
+
+    // Returns the entry of the color channel without HSV
+    u32 getEntry(u32 colorChannel);
+
+    /*
+        Returns the entry of the color channel with the HSV
+        applied, or nullopt if there is no room for it.
+    */
+    std::optional<u32> getHSVEntry(u32 colorChannel, u32 hsv);
+
+    inline usize getEntryCount() const { return entries.size(); }
+    inline usize getHSVEntryCount() const { return hsvEntryCount; }
+
+    bool prepare();
+
+    // Resolves the colors of every entry from the colors of the color channels
+    void update(std::span<const RGBA> channelColors, const std::vector<bool>& channelBlending);
+
+    void bind();
+
+private:
+    std::optional<u32> addEntry(u32 colorChannel, std::optional<u32> hsv);
+
+private:
+    Renderer& renderer;
+
+    struct Entry {
+        u32 colorChannel;
+        std::optional<u32> hsv;
+    };
+
+    std::map<u64, u32> entryIndicies;
+    std::vector<Entry> entries;
+    usize hsvEntryCount = 0;
+
+    std::vector<ColorTableEntry> colors;
+
+    Buffer* buffer = nullptr;
+};
@@ -42,6 +42,9 @@ void DifferenceMode::drawSceneHook() {
 
     storeGLStates();
 
+    auto& gpuTimer = renderer.getGPUTimer();
+    gpuTimer.begin("Difference mode");
+
     shader->use();
     shader->setTexture(shader->location("u_vanillaFrame"), 0, vanillaTexture);
     shader->setTexture(shader->location("u_bismuthFrame"), 1, bismuthTexture);
@@ -50,6 +53,8 @@ void DifferenceMode::drawSceneHook() {
 
     drawFullscreenQuad();
 
+    gpuTimer.end();
+
     restoreGLStates();
 
     CCDirector::get()->getOpenGLView()->swapBuffers();
@@ -0,0 +1,97 @@
+#include "GLExtensions.hpp"
+
+#ifndef GEODE_IS_WINDOWS
+#include <dlfcn.h>
+#endif
+
+namespace glext {
+
+DispatchComputeFunc dispatchCompute = nullptr;
+MemoryBarrierFunc   memoryBarrier   = nullptr;
+GetStringiFunc      getStringi      = nullptr;
+
+GetProgramBinaryFunc  getProgramBinary  = nullptr;
+ProgramBinaryFunc     programBinary     = nullptr;
+ProgramParameteriFunc programParameteri = nullptr;
+
+MaxShaderCompilerThreadsFunc maxShaderCompilerThreads = nullptr;
+
+QueryCounterFunc        queryCounter        = nullptr;
+GetQueryObjectui64vFunc getQueryObjectui64v = nullptr;
+
+MultiDrawElementsIndirectFunc      multiDrawElementsIndirect      = nullptr;
+MultiDrawElementsIndirectCountFunc multiDrawElementsIndirectCount = nullptr;
+
+static bool loaded = false;
+
+static void* findProcAddress(const char* name) {
+#ifdef GEODE_IS_WINDOWS
+    void* proc = (void*)wglGetProcAddress(name);
+
+    // wglGetProcAddress can return these values on failure as well
+    if (proc == (void*)0x1 || proc == (void*)0x2 || proc == (void*)0x3 || proc == (void*)-1)
+        return nullptr;
+    return proc;
+#else
+    // The OpenGL library is already loaded into the game
+    return dlsym(RTLD_DEFAULT, name);
+#endif
+}
+
+// The features that need a missing function are turned off by their callers
+static void* getProcAddress(const char* name) {
+    void* proc = findProcAddress(name);
+    if (!proc)
+        geode::log::info("OpenGL function {} is not available", name);
+    return proc;
+}
+
+void load() {
+    if (loaded) return;
+    loaded = true;
+
+    dispatchCompute = (DispatchComputeFunc)getProcAddress("glDispatchCompute");
+    memoryBarrier   = (MemoryBarrierFunc)getProcAddress("glMemoryBarrier");
+    getStringi      = (GetStringiFunc)getProcAddress("glGetStringi");
+
+    getProgramBinary  = (GetProgramBinaryFunc)getProcAddress("glGetProgramBinary");
+    programBinary     = (ProgramBinaryFunc)getProcAddress("glProgramBinary");
+    programParameteri = (ProgramParameteriFunc)getProcAddress("glProgramParameteri");
+
+    if (hasExtension("GL_KHR_parallel_shader_compile"))
+        maxShaderCompilerThreads = (MaxShaderCompilerThreadsFunc)getProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if (hasExtension("GL_ARB_parallel_shader_compile"))
+        maxShaderCompilerThreads = (MaxShaderCompilerThreadsFunc)getProcAddress("glMaxShaderCompilerThreadsARB");
+
+    // Lets the driver pick the amount of threads
+    if (maxShaderCompilerThreads)
+        maxShaderCompilerThreads(0xffffffff);
+
+    queryCounter        = (QueryCounterFunc)getProcAddress("glQueryCounter");
+    getQueryObjectui64v = (GetQueryObjectui64vFunc)getProcAddress("glGetQueryObjectui64v");
+
+    multiDrawElementsIndirect = (MultiDrawElementsIndirectFunc)getProcAddress("glMultiDrawElementsIndirect");
+
+    // Core since OpenGL 4.6, before that it is GL_ARB_indirect_parameters
+    multiDrawElementsIndirectCount = (MultiDrawElementsIndirectCountFunc)getProcAddress("glMultiDrawElementsIndirectCount");
+    if (!multiDrawElementsIndirectCount && hasExtension("GL_ARB_indirect_parameters"))
+        multiDrawElementsIndirectCount = (MultiDrawElementsIndirectCountFunc)getProcAddress("glMultiDrawElementsIndirectCountARB");
+}
+
+bool hasExtension(const char* name) {
+    if (!getStringi)
+        return false;
+
+    i32 count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+    for (i32 i = 0; i < count; i++) {
+        auto extension = (const char*)getStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <common.hpp>
+
+/*
+    The GLEW version the game ships with is older than some
+    of the OpenGL features the renderer uses. The functions
+    and constants of those features are loaded here instead.
+
+    Every function pointer is nullptr when the driver does
+    not support it, so always check before calling.
+*/
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_PARAMETER_BUFFER_ARB
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+#endif
+
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+
+#ifndef GL_NUM_EXTENSIONS
+#define GL_NUM_EXTENSIONS 0x821D
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace glext {
+
+using DispatchComputeFunc = void (APIENTRY*)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+using MemoryBarrierFunc   = void (APIENTRY*)(GLbitfield barriers);
+using GetStringiFunc      = const GLubyte* (APIENTRY*)(GLenum name, GLuint index);
+
+using GetProgramBinaryFunc  = void (APIENTRY*)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+using ProgramBinaryFunc     = void (APIENTRY*)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+using ProgramParameteriFunc = void (APIENTRY*)(GLuint program, GLenum pname, GLint value);
+
+using MaxShaderCompilerThreadsFunc = void (APIENTRY*)(GLuint count);
+
+using QueryCounterFunc        = void (APIENTRY*)(GLuint id, GLenum target);
+using GetQueryObjectui64vFunc = void (APIENTRY*)(GLuint id, GLenum pname, u64* params);
+
+using MultiDrawElementsIndirectFunc = void (APIENTRY*)(
+    GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride
+);
+
+using MultiDrawElementsIndirectCountFunc = void (APIENTRY*)(
+    GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride
+);
+
+extern DispatchComputeFunc dispatchCompute;
+extern MemoryBarrierFunc   memoryBarrier;
+extern GetStringiFunc      getStringi;
+
+extern GetProgramBinaryFunc  getProgramBinary;
+extern ProgramBinaryFunc     programBinary;
+extern ProgramParameteriFunc programParameteri;
+
+extern MaxShaderCompilerThreadsFunc maxShaderCompilerThreads;
+
+extern QueryCounterFunc        queryCounter;
+extern GetQueryObjectui64vFunc getQueryObjectui64v;
+
+extern MultiDrawElementsIndirectFunc      multiDrawElementsIndirect;
+extern MultiDrawElementsIndirectCountFunc multiDrawElementsIndirectCount;
+
+/*
+    Loads all of the functions above. This only
+    does work the first time it gets called.
+*/
+void load();
+
+bool hasExtension(const char* name);
+
+inline bool supportsComputeShaders() {
+    return dispatchCompute && memoryBarrier;
+}
+
+inline bool supportsIndirectDraws() {
+    return multiDrawElementsIndirect != nullptr;
+}
+
+// The driver can still have no binary formats, see ProgramCache.hpp
+inline bool supportsProgramBinaries() {
+    return getProgramBinary && programBinary && programParameteri;
+}
+
+/*
+    With GL_KHR_parallel_shader_compile, the driver compiles on
+    its own threads and GL_COMPLETION_STATUS_KHR can be polled.
+    Without it, querying the status of a shader blocks.
+*/
+inline bool supportsParallelShaderCompile() {
+    return maxShaderCompilerThreads != nullptr;
+}
+
+// Core since OpenGL 3.3, see GPUTimer.hpp
+inline bool supportsTimerQueries() {
+    return queryCounter && getQueryObjectui64v;
+}
+
+}
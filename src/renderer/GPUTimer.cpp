@@ -0,0 +1,98 @@
+#include "GPUTimer.hpp"
+#include "GLExtensions.hpp"
+
+GPUTimer::~GPUTimer() {
+    for (auto& frame : frames) {
+        if (!frame.queries.empty())
+            glDeleteQueries(frame.queries.size(), frame.queries.data());
+    }
+}
+
+void GPUTimer::beginFrame(bool enabled) {
+    this->enabled = enabled && glext::supportsTimerQueries();
+
+    currentFrame = (currentFrame + 1) % GPU_TIMER_FRAME_COUNT;
+    newResults = false;
+    readResults();
+
+    auto& frame = frames[currentFrame];
+    frame.usedQueries = 0;
+    frame.sections.clear();
+    openSection.reset();
+}
+
+GLuint GPUTimer::getQuery() {
+    auto& frame = frames[currentFrame];
+    if (frame.usedQueries == frame.queries.size()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+    return frame.usedQueries++;
+}
+
+void GPUTimer::begin(std::string name) {
+    if (!enabled)
+        return;
+    if (openSection)
+        end();
+
+    auto& frame = frames[currentFrame];
+    u32 query = getQuery();
+    glext::queryCounter(frame.queries[query], GL_TIMESTAMP);
+
+    openSection = frame.sections.size();
+    frame.sections.push_back({ std::move(name), query, query });
+}
+
+void GPUTimer::end() {
+    if (!enabled || !openSection)
+        return;
+
+    auto& frame = frames[currentFrame];
+    u32 query = getQuery();
+    glext::queryCounter(frame.queries[query], GL_TIMESTAMP);
+
+    frame.sections[openSection.value()].endQuery = query;
+    openSection.reset();
+}
+
+void GPUTimer::readResults() {
+    auto& frame = frames[currentFrame];
+    if (frame.sections.empty() || frame.usedQueries == 0)
+        return;
+
+    // The queries finish in order, so only the last one has to be checked
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    results.clear();
+    newResults = true;
+    for (auto& section : frame.sections) {
+        // Sections that never ended have no time
+        if (section.beginQuery == section.endQuery)
+            continue;
+
+        u64 beginTime = 0, endTime = 0;
+        glext::getQueryObjectui64v(frame.queries[section.beginQuery], GL_QUERY_RESULT, &beginTime);
+        glext::getQueryObjectui64v(frame.queries[section.endQuery], GL_QUERY_RESULT, &endTime);
+        u64 time = endTime > beginTime ? endTime - beginTime : 0;
+
+        auto it = std::find_if(results.begin(), results.end(), [&](const GPUTimerResult& result) {
+            return result.name == section.name;
+        });
+        if (it != results.end())
+            it->time += time;
+        else
+            results.push_back({ section.name, time });
+    }
+}
+
+u64 GPUTimer::getTotalTime() const {
+    u64 total = 0;
+    for (auto& result : results)
+        total += result.time;
+    return total;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <common.hpp>
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+    Measures how long the GPU spends on sections of a frame with
+    GL_TIMESTAMP queries, without making the CPU wait for the GPU.
+
+    Every frame writes its timestamps into its own set of queries.
+    A set is only read when it is about to be reused, which is
+    GPU_TIMER_FRAME_COUNT frames later, so its results are ready
+    unless the GPU is further behind than that. The results are
+    therefore always a few frames old.
+*/
+
+static constexpr usize GPU_TIMER_FRAME_COUNT = 3;
+
+struct GPUTimerResult {
+    std::string name;
+    u64 time;
+};
+
+class GPUTimer {
+public:
+    ~GPUTimer();
+
+    // Reads the results of the oldest frame and reuses its queries
+    void beginFrame(bool enabled);
+
+    // Sections can't be nested, but sections with the same name are added up
+    void begin(std::string name);
+
+    void end();
+
+    // The sections of the last frame that could be read, in the order they began
+    inline const std::vector<GPUTimerResult>& getResults() const { return results; }
+
+    // Whether the last beginFrame() read the results of a frame
+    inline bool hasNewResults() const { return newResults; }
+
+    u64 getTotalTime() const;
+
+private:
+    GLuint getQuery();
+
+    void readResults();
+
+private:
+    struct Section {
+        std::string name;
+        u32 beginQuery;
+        u32 endQuery;
+    };
+
+    struct Frame {
+        std::vector<GLuint> queries;
+        u32 usedQueries = 0;
+        std::vector<Section> sections;
+    };
+
+    std::array<Frame, GPU_TIMER_FRAME_COUNT> frames;
+    u32 currentFrame = 0;
+    bool enabled = false;
+
+    // The index of the section that hasn't ended yet
+    std::optional<u32> openSection;
+
+    std::vector<GPUTimerResult> results;
+    bool newResults = false;
+};
@@ -1,5 +1,7 @@
 #include "GroupManager.hpp"
 #include "Renderer.hpp"
+#include <Geode/binding/EffectGameObject.hpp>
+#include <glm/gtc/packing.hpp>
 
 using namespace geode::prelude;
 
@@ -24,9 +26,62 @@ GroupCombination::operator std::string() const {
     return ret + "]";
 }
     
+// These triggers target a group without moving, rotating, hiding or fading it
+static const std::unordered_set<i32> nonTransformingTriggerIds = {
+    1006, // Pulse
+    1268, // Spawn
+    1585, // Animate
+    1616, // Stop
+};
+
+// These triggers can only move, hide or fade a group, never rotate or scale it
+static const std::unordered_set<i32> nonRotatingTriggerIds = {
+    901,  // Move
+    1007, // Alpha
+    1049, // Toggle
+    1347, // Follow
+    1814, // Follow player Y
+};
+
+/*
+    Every trigger (and orb, pad or collectible that acts like one) is
+    an EffectGameObject. Any group id one of them refers to is treated
+    as changing, unless the trigger is known to leave it unchanged.
+    That includes the center or follow group, which is the second
+    group id of many triggers. A trigger that isn't known to only
+    translate its groups is treated as rotating and scaling them.
+*/
+void GroupManager::findTargetedGroups(cocos2d::CCArray* objects) {
+    targetedGroupIds.clear();
+    rotatedGroupIds.clear();
+
+    for (auto object : CCArrayExt<GameObject*>(objects)) {
+        auto effectObject = typeinfo_cast<EffectGameObject*>(object);
+        if (!effectObject)
+            continue;
+
+        if (nonTransformingTriggerIds.contains(effectObject->m_objectID))
+            continue;
+
+        bool isRotating = !nonRotatingTriggerIds.contains(effectObject->m_objectID);
+
+        for (i32 groupId : { effectObject->m_targetGroupID, effectObject->m_centerGroupID }) {
+            if (groupId <= 0)
+                continue;
+
+            targetedGroupIds.insert(groupId);
+            if (isRotating)
+                rotatedGroupIds.insert(groupId);
+        }
+    }
+}
+
 GroupCombinationIndex GroupManager::getGroupCombinationIndexForObject(GameObject* object) {
     auto comb = GroupCombination(object);
 
+    // Untargeted group ids never change the state of a group combination
+    comb.removeIf([&](GroupID groupId) { return !isGroupTargeted(groupId); });
+
     auto it = groupCombinationIndicies.find(comb);
     if (it != groupCombinationIndicies.end())
         return it->second;
@@ -115,13 +170,49 @@ void GroupManager::resetGroupStates() {
         groupState.positionalTransform = glm::mat4(1.0);
         groupState.localTransform = glm::mat4(1.0);
         groupState.offset = glm::vec2(0, 0);
+        groupState.opacity = 1.0;
     }
     disabledGroups.clear();
 }
 
+void GroupManager::packGroupStates(std::span<u32> packed) {
+    GroupCombinationState* groupCombStates = renderer.getGroupCombinationStates();
+
+    for (u32 i = 0; i < getGroupCombinationCount(); i++) {
+        auto& groupState = groupCombStates[i];
+        u32 location = groupStateLocations[i];
+        u32 offset = location & GROUP_STATE_OFFSET_MASK;
+
+        if ((location & GROUP_STATE_IS_AFFINE) != 0) {
+            memcpy(&packed[offset + 0], &groupState.positionalTransform, sizeof(glm::mat2));
+            memcpy(&packed[offset + 4], &groupState.localTransform, sizeof(glm::mat2));
+            offset += 8;
+        }
+
+        memcpy(&packed[offset], &groupState.offset, sizeof(glm::vec2));
+        packed[offset + 2] = glm::packHalf1x16(groupState.opacity);
+    }
+}
+
 void GroupManager::addGroupCombination(GroupCombination& comb, GroupCombinationIndex index) {
     groupCombinationIndicies[comb] = index;
 
+    bool isStatic = true;
+    bool isAffine = false;
+    for (auto groupId : comb.getSpan()) {
+        if (isGroupTargeted(groupId))
+            isStatic = false;
+        if (rotatedGroupIds.contains(groupId))
+            isAffine = true;
+    }
+
+    staticGroupCombinations.resize(index + 1);
+    staticGroupCombinations[index] = isStatic;
+
+    groupStateLocations.resize(index + 1);
+    groupStateLocations[index] = packedGroupStateSize | (isAffine ? GROUP_STATE_IS_AFFINE : 0);
+    packedGroupStateSize += isAffine ? AFFINE_GROUP_STATE_SIZE : TRANSLATION_GROUP_STATE_SIZE;
+
     for (auto groupId : comb.getSpan()) {
         usedGroupIds.insert(groupId);
 
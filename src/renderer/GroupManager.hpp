@@ -3,6 +3,7 @@
 #include <Geode/binding/GameObject.hpp>
 #include <common.hpp>
 #include <span>
+#include <unordered_set>
 
 /*
     Objects can have up to 10 group ids. Alpha, move, rotate
@@ -26,6 +27,20 @@
     to be applied to every object in parallel.
 
     To do that, every group combination is assigned an index.
+
+    Before any group combination is made, findTargetedGroups()
+    scans the triggers of the level for the group ids they target.
+    Group ids that are never targeted are removed from the group
+    combination of an object, so objects that only differ in
+    those group ids share the same group combination. A group
+    combination without any targeted group id can never move or
+    change opacity, so it is marked as static.
+
+    Only group combinations with a group id targeted by a rotate
+    trigger ever get a transform that isn't the identity. So only
+    their states store the transforms when the states are packed
+    for the shader, the rest only store their offset and opacity.
+    See GROUP_STATE_IS_AFFINE.
 */
 
 using GroupID = i16;
@@ -42,13 +57,21 @@ public:
         if (count < o.count) return true;
         if (count > o.count) return false;
 
-        for (i32 i = count - 1; i >= 0; i--) {
-            if (ids[i] < o.ids[i])
-                return true;
+        for (i32 i = 0; i < count; i++) {
+            if (ids[i] != o.ids[i])
+                return ids[i] < o.ids[i];
         }
         return false;
     }
 
+    // Removes the group ids matching the predicate, the rest stays sorted
+    template <typename F>
+    inline void removeIf(F predicate) {
+        auto end = std::remove_if(ids.begin(), ids.begin() + count, predicate);
+        std::fill(end, ids.end(), 0);
+        count = end - ids.begin();
+    }
+
     inline std::span<GroupID> getSpan() {
         return std::span<GroupID>(ids.data(), &ids[count]);
     }
@@ -67,8 +90,29 @@ public:
     inline GroupManager(Renderer& renderer)
         : renderer(renderer) {}
     
+    void findTargetedGroups(cocos2d::CCArray* objects);
+
+    inline bool isGroupTargeted(GroupID groupId) const {
+        return targetedGroupIds.contains(groupId);
+    }
+
     GroupCombinationIndex getGroupCombinationIndexForObject(GameObject* object);
 
+    inline bool isGroupCombinationStatic(GroupCombinationIndex index) const {
+        return staticGroupCombinations[index];
+    }
+
+    // The location of the packed state of the group combination in the DRB
+    inline u32 getGroupStateLocation(GroupCombinationIndex index) const {
+        return groupStateLocations[index];
+    }
+
+    // The size of all packed states in words
+    inline u32 getPackedGroupStateSize() const { return packedGroupStateSize; }
+
+    // Packs the state of every group combination for the shader
+    void packGroupStates(std::span<u32> packed);
+
     inline GroupID getMaxGroupId() const { return maxGroupId; }
 
     inline u32 getGroupCombinationCount() const { return currentGroupCombinationIndex; }
@@ -101,6 +145,17 @@ private:
     GroupCombinationIndex currentGroupCombinationIndex = 0;
     std::map<GroupCombination, GroupCombinationIndex> groupCombinationIndicies;
 
+    // Group ids that are the target of at least one trigger
+    std::unordered_set<GroupID> targetedGroupIds;
+    // Group ids that at least one trigger might rotate or scale
+    std::unordered_set<GroupID> rotatedGroupIds;
+
+    // Whether the group combination at an index is static
+    std::vector<bool> staticGroupCombinations;
+
+    std::vector<u32> groupStateLocations;
+    u32 packedGroupStateSize = 0;
+
     /*
         This is a map with the key being a group id and the value being
         an array of all group combination indicies it belongs to.
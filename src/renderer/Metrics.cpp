@@ -0,0 +1,187 @@
+#include "Metrics.hpp"
+
+using namespace geode::prelude;
+
+static const char* getMetricTypeName(MetricType type) {
+    switch (type) {
+        case MetricType::COUNTER:   return "counter";
+        case MetricType::GAUGE:     return "gauge";
+        case MetricType::HISTOGRAM: return "histogram";
+    }
+    return "";
+}
+
+Metrics::~Metrics() {
+    closeSink();
+}
+
+MetricId Metrics::addMetric(std::string name, MetricType type) {
+    metrics.push_back({ std::move(name), type });
+    return metrics.size() - 1;
+}
+
+MetricId Metrics::addCounter(std::string name) {
+    return addMetric(std::move(name), MetricType::COUNTER);
+}
+
+MetricId Metrics::addGauge(std::string name) {
+    return addMetric(std::move(name), MetricType::GAUGE);
+}
+
+MetricId Metrics::addHistogram(std::string name) {
+    return addMetric(std::move(name), MetricType::HISTOGRAM);
+}
+
+MetricsSinkFormat Metrics::getSinkFormatSetting() {
+    auto format = Mod::get()->getSettingValue<std::string>("metrics_sink");
+    if (format == "jsonl")
+        return MetricsSinkFormat::JSONL;
+    if (format == "csv")
+        return MetricsSinkFormat::CSV;
+    return MetricsSinkFormat::NONE;
+}
+
+bool Metrics::openSink(MetricsSinkFormat format) {
+    closeSink();
+    if (format == MetricsSinkFormat::NONE)
+        return true;
+
+    const char* extension = format == MetricsSinkFormat::JSONL ? "jsonl" : "csv";
+    sinkPath = Mod::get()->getSaveDir() / fmt::format("metrics-{}.{}", std::time(nullptr), extension);
+
+    sinkFile.open(sinkPath);
+    if (!sinkFile) {
+        log::error("Failed to open the metrics sink {}", sinkPath.string());
+        return false;
+    }
+
+    sinkFormat    = format;
+    sinkStartTime = getTime();
+    frameIndex    = 0;
+    for (auto& metric : metrics)
+        metric.samples.clear();
+
+    if (format == MetricsSinkFormat::JSONL) {
+        sinkFile << fmt::format("{{\"type\":\"header\",\"version\":\"{}\",\"metrics\":{{", Mod::get()->getVersion().toVString());
+        for (usize i = 0; i < metrics.size(); i++)
+            sinkFile << fmt::format("{}\"{}\":\"{}\"", i == 0 ? "" : ",", metrics[i].name, getMetricTypeName(metrics[i].type));
+        sinkFile << "}}\n";
+    } else {
+        sinkFile << "frame,time_ns";
+        for (auto& metric : metrics)
+            sinkFile << "," << metric.name;
+        sinkFile << "\n";
+    }
+
+    log::info("Streaming renderer metrics to {}", sinkPath.string());
+    return true;
+}
+
+void Metrics::writeFrame() {
+    u64 time = getTime() - sinkStartTime;
+
+    if (sinkFormat == MetricsSinkFormat::JSONL) {
+        sinkFile << fmt::format("{{\"type\":\"frame\",\"frame\":{},\"time_ns\":{}", frameIndex, time);
+        for (auto& metric : metrics) {
+            // A histogram without samples in this frame has no value
+            if (metric.type == MetricType::HISTOGRAM && metric.frameSampleCount == 0)
+                sinkFile << fmt::format(",\"{}\":null", metric.name);
+            else
+                sinkFile << fmt::format(",\"{}\":{}", metric.name, metric.value);
+        }
+        sinkFile << "}\n";
+    } else {
+        sinkFile << fmt::format("{},{}", frameIndex, time);
+        for (auto& metric : metrics) {
+            if (metric.type == MetricType::HISTOGRAM && metric.frameSampleCount == 0)
+                sinkFile << ",";
+            else
+                sinkFile << fmt::format(",{}", metric.value);
+        }
+        sinkFile << "\n";
+    }
+}
+
+void Metrics::endFrame() {
+    if (isSinkOpen()) {
+        for (auto& metric : metrics) {
+            if (metric.type != MetricType::HISTOGRAM)
+                metric.samples.push_back(metric.value);
+        }
+        writeFrame();
+        frameIndex++;
+    }
+
+    for (auto& metric : metrics) {
+        metric.lastValue = metric.value;
+        metric.frameSampleCount = 0;
+        if (metric.type != MetricType::GAUGE)
+            metric.value = 0;
+    }
+}
+
+/*
+    The JSONL sink ends with a summary line. The summary of the
+    CSV sink is its own file, since it has different columns.
+*/
+bool Metrics::writeSummary() {
+    std::ofstream summaryFile;
+    std::ostream* out = &sinkFile;
+
+    auto version = Mod::get()->getVersion().toVString();
+
+    if (sinkFormat == MetricsSinkFormat::JSONL)
+        sinkFile << fmt::format("{{\"type\":\"summary\",\"version\":\"{}\",\"frames\":{},\"metrics\":{{", version, frameIndex);
+    else {
+        auto summaryPath = sinkPath;
+        summaryPath.replace_extension();
+        summaryFile.open(summaryPath.string() + "-summary.csv");
+        if (!summaryFile)
+            return false;
+        out = &summaryFile;
+        summaryFile << "version,metric,type,samples,total,mean,p50,p95,p99,max\n";
+    }
+
+    for (usize i = 0; i < metrics.size(); i++) {
+        auto& metric = metrics[i];
+
+        u64 total = 0;
+        for (auto sample : metric.samples)
+            total += sample;
+        auto stats = getSampleStats(metric.samples);
+
+        if (sinkFormat == MetricsSinkFormat::JSONL) {
+            *out << fmt::format(
+                "{}\"{}\":{{\"type\":\"{}\",\"samples\":{},\"total\":{},\"mean\":{:.1f},\"p50\":{},\"p95\":{},\"p99\":{},\"max\":{}}}",
+                i == 0 ? "" : ",", metric.name, getMetricTypeName(metric.type), metric.samples.size(),
+                total, stats.mean, stats.p50, stats.p95, stats.p99, stats.max
+            );
+        } else {
+            *out << fmt::format(
+                "{},{},{},{},{},{:.1f},{},{},{},{}\n",
+                version, metric.name, getMetricTypeName(metric.type), metric.samples.size(),
+                total, stats.mean, stats.p50, stats.p95, stats.p99, stats.max
+            );
+        }
+    }
+
+    if (sinkFormat == MetricsSinkFormat::JSONL)
+        sinkFile << "}}\n";
+
+    return out->good();
+}
+
+void Metrics::closeSink() {
+    if (!isSinkOpen())
+        return;
+
+    if (writeSummary() && sinkFile.good())
+        log::info("Wrote renderer metrics of {} frame(s) to {}", frameIndex, sinkPath.string());
+    else
+        log::error("Failed to write renderer metrics to {}", sinkPath.string());
+
+    sinkFile.close();
+    sinkFormat = MetricsSinkFormat::NONE;
+    for (auto& metric : metrics)
+        metric.samples = {};
+}
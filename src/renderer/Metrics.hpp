@@ -0,0 +1,101 @@
+#pragma once
+
+#include <common.hpp>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+    Named metrics that the renderer updates every frame. A metric
+    is registered once and then updated through its id, which is
+    just an index, so an update costs about as much as writing a
+    member variable.
+
+    - A counter counts things during a frame, like drawn sprites.
+    - A gauge keeps its value until it is set again, like a buffer size.
+    - A histogram takes time samples in nanoseconds. Its value in a
+      frame is the sum of the samples of that frame.
+
+    When the metrics_sink setting isn't "none", every frame is
+    streamed to a JSONL or CSV file in the save directory, and a
+    summary with percentiles is written when the level is exited.
+    Counters and gauges get one sample per frame, histograms one
+    per recorded time.
+*/
+
+using MetricId = u32;
+
+enum class MetricType {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM
+};
+
+enum class MetricsSinkFormat {
+    NONE,
+    JSONL,
+    CSV
+};
+
+class Metrics {
+public:
+    ~Metrics();
+
+    MetricId addCounter(std::string name);
+    MetricId addGauge(std::string name);
+    MetricId addHistogram(std::string name);
+
+    inline void add(MetricId id, u64 count = 1) { metrics[id].value += count; }
+
+    inline void set(MetricId id, u64 value) { metrics[id].value = value; }
+
+    inline void record(MetricId id, u64 time) {
+        auto& metric = metrics[id];
+        metric.value += time;
+        metric.frameSampleCount++;
+        if (sinkFormat != MetricsSinkFormat::NONE)
+            metric.samples.push_back(time);
+    }
+
+    // The value of the metric in the last frame that ended
+    inline u64 getLastValue(MetricId id) const { return metrics[id].lastValue; }
+
+    inline bool isSinkOpen() const { return sinkFormat != MetricsSinkFormat::NONE; }
+
+    // Every metric has to be registered before this
+    bool openSink(MetricsSinkFormat format);
+
+    // Writes the summary and closes the sink
+    void closeSink();
+
+    // Streams the frame to the sink and resets the counters and histograms
+    void endFrame();
+
+    static MetricsSinkFormat getSinkFormatSetting();
+
+private:
+    MetricId addMetric(std::string name, MetricType type);
+
+    void writeFrame();
+
+    bool writeSummary();
+
+private:
+    struct Metric {
+        std::string name;
+        MetricType type;
+        u64 value = 0;
+        u64 lastValue = 0;
+        u32 frameSampleCount = 0;
+        // Only collected while the sink is open
+        std::vector<u64> samples;
+    };
+
+    std::vector<Metric> metrics;
+
+    MetricsSinkFormat sinkFormat = MetricsSinkFormat::NONE;
+    std::filesystem::path sinkPath;
+    std::ofstream sinkFile;
+    u64 sinkStartTime = 0;
+    u64 frameIndex = 0;
+};
@@ -3,7 +3,9 @@
 #include "Geode/cocos/sprite_nodes/CCSpriteFrame.h"
 #include "ObjectSpriteUnpacker.hpp"
 #include "Renderer.hpp"
+#include "GLExtensions.hpp"
 #include "SpriteMeshDictionary.hpp"
+#include "UniformSpriteDictionary.hpp"
 #include "common.hpp"
 #include "glm/fwd.hpp"
 #include "math/ConvexList.hpp"
@@ -17,11 +19,18 @@ using namespace geode::prelude;
 #define QUAD_TL 2
 #define QUAD_TR 3
 
+// A multiple of 3, so the triangles of a mesh are never split over two sprites
+#define MAX_MESH_POINTS_PER_PULLED_SPRITE 255
+
 ObjectBatch::~ObjectBatch() {
     if (vertexBuffer)
         Buffer::destroy(vertexBuffer);
     if (indexBuffer)
         Buffer::destroy(indexBuffer);
+    if (spriteBuffer)
+        Buffer::destroy(spriteBuffer);
+    if (meshPointBuffer)
+        Buffer::destroy(meshPointBuffer);
     if (vao)
         glDeleteVertexArrays(1, &vao);
 }
@@ -79,32 +88,15 @@ SpriteVertexTransforms ObjectBatch::getSpriteVertexTransform(
     };
 }
 
-void ObjectBatch::prepareSpriteMeshWrite(
-    GameObject* object,
-    cocos2d::CCSprite* sprite,
-    SpriteType type,
-    const cocos2d::CCAffineTransform& transform
-) {
-    SpriteSheet spriteSheet = unpacker.getSpritesheetOfObject(object, type);
-    if (spriteSheetFilter != (SpriteSheet)-1 && spriteSheet != spriteSheetFilter)
-        return;
-
-    u32 colorChannel = type == SpriteType::DETAIL ? object->m_activeDetailColorID : object->m_activeMainColorID;
+void ObjectBatch::prepareSpriteMeshWrite(const ObjectSpriteRecord& record) {
+    currentSpriteVertexTransforms    = record.transforms;
+    currentSpriteObjectStartPosition = record.objectStartPosition;
 
-    bool isSpriteBlack = (sprite == object) ? object->m_isObjectBlack : object->m_isColorSpriteBlack;
-    if (isSpriteBlack)
-        colorChannel = COLOR_CHANNEL_BLACK;
-    if (type == SpriteType::GLOW && object->m_glowColorIsLBG)
-        colorChannel = COLOR_CHANNEL_LBG;
-    if (type == SpriteType::DETAIL)
-        colorChannel |= A_COLOR_CHANNEL_IS_SPRITE_DETAIL;
-
-    currentSpriteVertexTransforms    = getSpriteVertexTransform(sprite, transform, spriteSheet);
-    currentSpriteObjectStartPosition = ccPointToGLM(object->m_startPosition);
-
-    currentSpriteSRBIndex     = renderer.getObjectSRBIndex(object);
-    currentSpriteColorChannel = colorChannel;
-    currentSpriteSpriteSheet  = (u8)spriteSheet;
+    currentSpriteSRBIndex     = record.srbIndex;
+    currentSpriteIsBaked      = record.isBaked;
+    currentSpriteColorChannel = record.colorChannel;
+    currentSpriteSpriteSheet  = record.spriteSheet;
+    currentSpriteShaderSprite = record.shaderSprite;
     currentSpriteVertexIndex  = verticies.size();
 }
 
@@ -115,9 +107,14 @@ void ObjectBatch::writeSpriteVertex(glm::vec2 pos) {
 
     auto& transforms = currentSpriteVertexTransforms;
 
-    vertex.positionOffset = transforms.positionRight * pos.x +
-                            transforms.positionUp    * pos.y +
-                            transforms.positionBottomLeft - currentSpriteObjectStartPosition;
+    glm::vec2 position = transforms.positionRight * pos.x +
+                         transforms.positionUp    * pos.y +
+                         transforms.positionBottomLeft;
+    glm::vec2 offset   = position - currentSpriteObjectStartPosition;
+
+    vertex.positionOffset = currentSpriteIsBaked ? position : offset;
+
+    currentObjectExtent = std::max(currentObjectExtent, glm::length(offset));
     
     vertex.texCoord = transforms.texCoordRight * pos.x +
                       transforms.texCoordUp    * pos.y +
@@ -126,6 +123,15 @@ void ObjectBatch::writeSpriteVertex(glm::vec2 pos) {
     vertex.srbIndex     = currentSpriteSRBIndex;
     vertex.colorChannel = currentSpriteColorChannel;
     vertex.spriteSheet  = currentSpriteSpriteSheet;
+    vertex.shaderSprite = currentSpriteShaderSprite.index;
+
+    // Shader sprites are sampled with the position in the sprite
+    if (currentSpriteShaderSprite.index != 0) {
+        vertex.texCoord = glm::vec2(
+            currentSpriteShaderSprite.flipX ? 1.0f - pos.x : pos.x,
+            currentSpriteShaderSprite.flipY ? 1.0f - pos.y : pos.y
+        );
+    }
 }
 
 void ObjectBatch::writeSpriteIndex(u32 index) {
@@ -145,34 +151,232 @@ void ObjectBatch::writeSpriteMeshFromConvexList(const ConvexList& list) {
     });
 }
 
+/*
+    The opaque mesh gets its own verticies, written after the
+    verticies of the whole sprite. Verticies written later are
+    nearer in the depth pass, so the whole sprite is rejected
+    by the depth test wherever its opaque mesh has been drawn.
+*/
+void ObjectBatch::writeOpaqueSpriteMesh(const ObjectSpriteRecord& record, u32 firstSpriteIndex) {
+    // Without an opaque mesh, the translucent fragments of the whole sprite are discarded in the opaque pass
+    if (!record.opaqueMesh) {
+        opaqueIndicies.insert(opaqueIndicies.end(), indicies.begin() + firstSpriteIndex, indicies.end());
+        return;
+    }
+
+    if (renderer.isUseVertexPulling()) {
+        writePulledSpriteMesh(record, record.opaqueMesh, opaqueIndicies);
+        return;
+    }
+
+    record.opaqueMesh->triangulate([&](const glm::vec2& p1, const glm::vec2& p2, const glm::vec2& p3) {
+        u32 vertexIndex = verticies.size();
+        writeSpriteVertex(p1);
+        writeSpriteVertex(p2);
+        writeSpriteVertex(p3);
+        opaqueIndicies.push_back(vertexIndex + 0);
+        opaqueIndicies.push_back(vertexIndex + 1);
+        opaqueIndicies.push_back(vertexIndex + 2);
+    });
+}
+
+/*
+    With vertex pulling, a sprite is written as a single ObjectSprite
+    and the object shader builds its verticies from it. The points of
+    every mesh are only stored once per batch, and the indicies encode
+    the sprite and a point of its mesh (see SPRITE_MESH_POINT_BITS).
+*/
+u32 ObjectBatch::pushPulledSprite(const ObjectSpriteRecord& record, u32 firstMeshPoint) {
+    auto& transforms = record.transforms;
+
+    ObjectSprite sprite;
+    sprite.positionBottomLeft = transforms.positionBottomLeft;
+    if (!record.isBaked)
+        sprite.positionBottomLeft -= record.objectStartPosition;
+    sprite.positionRight      = transforms.positionRight;
+    sprite.positionUp         = transforms.positionUp;
+    sprite.texCoordBottomLeft = transforms.texCoordBottomLeft;
+
+    sprite.srbIndex       = record.srbIndex;
+    sprite.firstMeshPoint = firstMeshPoint;
+    sprite.colorChannel   = record.colorChannel;
+    sprite.info           = record.spriteSheet | (u32)record.shaderSprite.index << OBJECT_SPRITE_SHADER_SPRITE_BIT;
+
+    // The texture vectors are always axis aligned, see getSpriteVertexTransform()
+    if (transforms.texCoordRight.y == 0.0f && transforms.texCoordUp.x == 0.0f) {
+        sprite.texCoordSize = { transforms.texCoordRight.x, transforms.texCoordUp.y };
+    } else {
+        sprite.texCoordSize = { transforms.texCoordRight.y, transforms.texCoordUp.x };
+        sprite.info |= OBJECT_SPRITE_TEXTURE_ROTATED;
+    }
+
+    if (record.shaderSprite.flipX) sprite.info |= OBJECT_SPRITE_SHADER_FLIP_X;
+    if (record.shaderSprite.flipY) sprite.info |= OBJECT_SPRITE_SHADER_FLIP_Y;
+
+    pulledSprites.push_back(sprite);
+    return pulledSprites.size() - 1;
+}
+
+std::pair<u32, u32> ObjectBatch::getMeshPointRange(const ConvexList& mesh) {
+    auto it = meshPointRanges.find(&mesh);
+    if (it != meshPointRanges.end())
+        return it->second;
+
+    u32 firstPoint = meshPoints.size();
+    mesh.triangulate([&](const glm::vec2& p1, const glm::vec2& p2, const glm::vec2& p3) {
+        meshPoints.push_back(p1);
+        meshPoints.push_back(p2);
+        meshPoints.push_back(p3);
+    });
+
+    std::pair<u32, u32> range = { firstPoint, (u32)meshPoints.size() - firstPoint };
+    meshPointRanges[&mesh] = range;
+    return range;
+}
+
+void ObjectBatch::writePulledSpriteMesh(const ObjectSpriteRecord& record, const ConvexList* mesh, std::vector<u32>& indexList) {
+    // The points of the quad are always the first ones
+    if (!mesh) {
+        u32 spriteIndex = pushPulledSprite(record, 0);
+        for (u32 point : { QUAD_BL, QUAD_TL, QUAD_TR, QUAD_BL, QUAD_TR, QUAD_BR })
+            indexList.push_back(spriteIndex << SPRITE_MESH_POINT_BITS | point);
+        return;
+    }
+
+    auto [firstPoint, pointCount] = getMeshPointRange(*mesh);
+
+    // Meshes with more points than an index can address are split over multiple sprites
+    for (u32 offset = 0; offset < pointCount; offset += MAX_MESH_POINTS_PER_PULLED_SPRITE) {
+        u32 spriteIndex = pushPulledSprite(record, firstPoint + offset);
+        u32 count = std::min<u32>(pointCount - offset, MAX_MESH_POINTS_PER_PULLED_SPRITE);
+
+        for (u32 point = 0; point < count; point++)
+            indexList.push_back(spriteIndex << SPRITE_MESH_POINT_BITS | point);
+    }
+}
+
+void ObjectBatch::writePulledSprite(const ObjectSpriteRecord& record) {
+    auto mesh = record.trimmedMesh ? &record.trimmedMesh.value() : record.mesh;
+    writePulledSpriteMesh(record, mesh, indicies);
+
+    // The mesh is always inside of the quad of the sprite
+    auto& transforms = record.transforms;
+    for (glm::vec2 corner : { glm::vec2(0, 0), glm::vec2(1, 0), glm::vec2(0, 1), glm::vec2(1, 1) }) {
+        glm::vec2 position = transforms.positionRight * corner.x +
+                             transforms.positionUp    * corner.y +
+                             transforms.positionBottomLeft;
+        currentObjectExtent = std::max(currentObjectExtent, glm::length(position - record.objectStartPosition));
+    }
+}
+
+void ObjectBatch::writeSprite(const ObjectSpriteRecord& record) {
+    // The sprite is fully covered by sprites drawn after it
+    if (record.trimmedMesh && record.trimmedMesh->isEmpty())
+        return;
+
+    if (record.isMerged)
+        return;
+
+    writtenSpriteCount++;
+    if (record.shaderSprite.index != 0)
+        shaderSpriteCount++;
+
+    u32 firstSpriteIndex = indicies.size();
+
+    if (renderer.isUseVertexPulling()) {
+        writePulledSprite(record);
+    } else {
+        prepareSpriteMeshWrite(record);
+
+        if (record.trimmedMesh) {
+            writeSpriteMeshFromConvexList(*record.trimmedMesh);
+        } else if (record.mesh) {
+            writeSpriteMeshFromConvexList(*record.mesh);
+        } else {
+            writeSpriteVertex({ 0, 0 });
+            writeSpriteVertex({ 1, 0 });
+            writeSpriteVertex({ 0, 1 });
+            writeSpriteVertex({ 1, 1 });
+
+            writeSpriteIndex(QUAD_BL);
+            writeSpriteIndex(QUAD_TL);
+            writeSpriteIndex(QUAD_TR);
+            writeSpriteIndex(QUAD_BL);
+            writeSpriteIndex(QUAD_TR);
+            writeSpriteIndex(QUAD_BR);
+        }
+    }
+
+    // Glow sprites are always blended, so they are never opaque
+    if (renderer.isUseDepthPass() && record.type != SpriteType::GLOW)
+        writeOpaqueSpriteMesh(record, firstSpriteIndex);
+}
+
 void ObjectBatch::receiveUnpackedSprite(
     GameObject* object,
     cocos2d::CCSprite* sprite,
     SpriteType type,
     const cocos2d::CCAffineTransform& transform
 ) {
-    prepareSpriteMeshWrite(object, sprite, type, transform);
+    SpriteSheet spriteSheet = unpacker.getSpritesheetOfObject(object, type);
+    if (spriteSheetFilter != (SpriteSheet)-1 && spriteSheet != spriteSheetFilter)
+        return;
 
-    ConvexList* spriteMesh = SpriteMeshDictionary::getSpriteMeshForSprite(sprite);
+    u32 colorChannel = type == SpriteType::DETAIL ? object->m_activeDetailColorID : object->m_activeMainColorID;
 
-    if (spriteMesh) {
-        writeSpriteMeshFromConvexList(*spriteMesh);
-    } else {
-        writeSpriteVertex({ 0, 0 });
-        writeSpriteVertex({ 1, 0 });
-        writeSpriteVertex({ 0, 1 });
-        writeSpriteVertex({ 1, 1 });
-
-        writeSpriteIndex(QUAD_BL);
-        writeSpriteIndex(QUAD_TL);
-        writeSpriteIndex(QUAD_TR);
-        writeSpriteIndex(QUAD_BL);
-        writeSpriteIndex(QUAD_TR);
-        writeSpriteIndex(QUAD_BR);
+    bool isSpriteBlack = (sprite == object) ? object->m_isObjectBlack : object->m_isColorSpriteBlack;
+    if (isSpriteBlack)
+        colorChannel = COLOR_CHANNEL_BLACK;
+    if (type == SpriteType::GLOW && object->m_glowColorIsLBG)
+        colorChannel = COLOR_CHANNEL_LBG;
+
+    bool isColorStaticOpaque = renderer.isColorChannelStaticOpaque(colorChannel);
+
+    // From here on the color channel is the index of its entry in the color table
+    auto& colorTable = renderer.getColorTable();
+    std::optional<u32> colorEntry;
+    if (auto hsv = ColorTable::getHSVOfSprite(object, type)) {
+        colorEntry = colorTable.getHSVEntry(colorChannel, hsv.value());
+        if (!colorEntry)
+            shaderFeatures |= OBJECT_SHADER_FEATURE_HSV; // The table is full
     }
+    // Not value_or(), which would add the plain entry for every HSV sprite
+    if (colorEntry)
+        colorChannel = colorEntry.value();
+    else
+        colorChannel = colorTable.getEntry(colorChannel);
+
+    if (type == SpriteType::DETAIL)
+        colorChannel |= A_COLOR_CHANNEL_IS_SPRITE_DETAIL;
+
+    ObjectSpriteRecord record;
+    record.transforms          = getSpriteVertexTransform(sprite, transform, spriteSheet);
+    record.objectStartPosition = ccPointToGLM(object->m_startPosition);
+    record.mesh                = SpriteMeshDictionary::getSpriteMeshForSprite(sprite);
+    record.opaqueMesh          = SpriteMeshDictionary::getOpaqueMeshForSprite(sprite);
+    record.srbIndex            = renderer.getObjectSRBIndex(object);
+    record.colorChannel        = colorChannel;
+    record.spriteSheet         = (u8)spriteSheet;
+    record.type                = type;
+    record.isBaked             = renderer.isObjectBaked(record.srbIndex);
+    record.isMerged            = false;
+
+    if (renderer.isUseSpriteMerging())
+        record.uniformColor = UniformSpriteDictionary::getUniformColorForSprite(sprite);
+    if (renderer.isUseShaderSprites())
+        record.shaderSprite = renderer.getShaderSpriteManager().getShaderSpriteOfSprite(sprite);
+
+    record.isOccluder =
+        record.isBaked &&
+        record.opaqueMesh &&
+        type != SpriteType::GLOW &&
+        isColorStaticOpaque;
+
+    spriteRecords.push_back(std::move(record));
+    objectRecords.back().spriteCount++;
 }
 
-void ObjectBatch::writeGameObject(GameObject* object) {
+void ObjectBatch::collectGameObject(GameObject* object, u32 sorterLayer) {
     float originalScaleX = object->getScaleX();
     float originalScaleY = object->getScaleY();
 
@@ -181,35 +385,567 @@ void ObjectBatch::writeGameObject(GameObject* object) {
         object->setScaleY(object->m_scaleY);
     }
 
+    objectRecords.push_back({ object, sorterLayer, (u32)spriteRecords.size(), 0 });
     unpacker.unpackObject(object);
 
     object->setScaleX(originalScaleX);
     object->setScaleY(originalScaleY);
 }
 
-void ObjectBatch::finishWriting() {
-    /*
-    quadCount = currentQuadIndex;
-
-    indicies.resize(quadCount);
-
-    usize vertexIndex = 0;
-    for (usize i = 0; i < quadCount; i++) {
-        ObjectIndicies& objIndicies = indicies[i];
-        objIndicies.indicies[0] = vertexIndex + QUAD_BL;
-        objIndicies.indicies[1] = vertexIndex + QUAD_TL;
-        objIndicies.indicies[2] = vertexIndex + QUAD_TR;
-        objIndicies.indicies[3] = vertexIndex + QUAD_BL;
-        objIndicies.indicies[4] = vertexIndex + QUAD_TR;
-        objIndicies.indicies[5] = vertexIndex + QUAD_BR;
-        vertexIndex += 4;
+void ObjectBatch::writeGameObject(const ObjectRecord& record) {
+    GameObject* object = record.object;
+
+    u32 firstIndex = indicies.size();
+    u32 firstOpaqueIndex = opaqueIndicies.size();
+    currentObjectExtent = 0.0f;
+
+    for (u32 i = 0; i < record.spriteCount; i++)
+        writeSprite(spriteRecords[record.firstSprite + i]);
+
+    float extent = currentObjectExtent;
+    // Pulsating objects can get bigger than their original size, see calculateAudioScale()
+    if (object->m_usesAudioScale) {
+        float maxAudioScale = ORB_MAX_AUDIO_SCALE;
+        if (object->m_customAudioScale)
+            maxAudioScale = std::max({ maxAudioScale, object->m_minAudioScale, object->m_maxAudioScale });
+        extent *= maxAudioScale;
     }
-    
-    quadsSrbIndicies.resize(quadCount);
 
-    for (usize i = 0; i < quadCount; i++)
-        quadsSrbIndicies[i] = quads[i].verticies[0].srbIndex;
-    */
+    addObjectToChunks(
+        object,
+        firstIndex, indicies.size() - firstIndex,
+        firstOpaqueIndex, opaqueIndicies.size() - firstOpaqueIndex,
+        extent
+    );
+}
+
+/*
+    The objects come in by sorter layer, and sorted by z-order
+    within a layer. The game draws the layers one after another,
+    so that order is kept. Objects of one layer with the same
+    z-order have no defined draw order between each other, so we
+    are free to put the baked objects first, group the rest by
+    group combination and sort them on the x-axis. That way the
+    chunks end up small.
+*/
+void ObjectBatch::sortObjectsForChunking() {
+    std::stable_sort(
+        objects.begin(),
+        objects.end(),
+        [&](const std::pair<GameObject*, u32>& objectA, const std::pair<GameObject*, u32>& objectB) {
+            auto [a, layerA] = objectA;
+            auto [b, layerB] = objectB;
+            if (layerA != layerB)
+                return layerA < layerB;
+
+            i32 zA = a->getObjectZOrder();
+            i32 zB = b->getObjectZOrder();
+            if (zA != zB)
+                return zA < zB;
+
+            usize srbIndexA = renderer.getObjectSRBIndex(a);
+            usize srbIndexB = renderer.getObjectSRBIndex(b);
+
+            bool isBakedA = renderer.isObjectBaked(srbIndexA);
+            bool isBakedB = renderer.isObjectBaked(srbIndexB);
+            if (isBakedA != isBakedB)
+                return isBakedA;
+
+            auto combA = renderer.getGroupCombinationIndex(srbIndexA);
+            auto combB = renderer.getGroupCombinationIndex(srbIndexB);
+            if (!isBakedA && combA != combB)
+                return combA < combB;
+
+            return a->m_startPosition.x < b->m_startPosition.x;
+        }
+    );
+}
+
+#define OCCLUDER_GRID_CELL_SIZE   128.0f
+#define MAX_OCCLUDERS_PER_SPRITE  32
+#define MAX_TRIMMED_MESH_POLYGONS 16
+
+static void getSpriteBounds(const SpriteVertexTransforms& transforms, glm::vec2& min, glm::vec2& max) {
+    glm::vec2 bl = transforms.positionBottomLeft;
+    glm::vec2 br = bl + transforms.positionRight;
+    glm::vec2 tl = bl + transforms.positionUp;
+    glm::vec2 tr = br + transforms.positionUp;
+
+    min = glm::min(glm::min(bl, br), glm::min(tl, tr));
+    max = glm::max(glm::max(bl, br), glm::max(tl, tr));
+}
+
+static u64 getOccluderGridCell(i32 x, i32 y) {
+    return ((u64)(u32)x << 32) | (u64)(u32)y;
+}
+
+/*
+    Removes the parts of baked sprites that are covered by the
+    opaque mesh of an occluder (see ObjectSpriteRecord::isOccluder)
+    drawn after them. Both never move, so the covered part would
+    always be drawn over.
+
+    The sprites are walked from the last drawn to the first. Every
+    occluder is put in a grid, so a sprite only has to be tested
+    against the occluders near it. The meshes of the occluders are
+    transformed into the texture space of the sprite, where they are
+    subtracted from the mesh of the sprite.
+*/
+void ObjectBatch::trimOccludedSprites() {
+    std::unordered_map<u64, std::vector<u32>> occluderGrid;
+    std::vector<u32> nearbyOccluders;
+
+    ConvexList quadMesh;
+    glm::vec2 quadPoints[] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+    quadMesh.addPolygon(ConvexPolygon::fromPoints(quadPoints));
+
+    trimmedSpriteCount = 0;
+    removedSpriteCount = 0;
+
+    for (isize i = (isize)spriteRecords.size() - 1; i >= 0; i--) {
+        auto& record = spriteRecords[i];
+
+        glm::vec2 boundsMin, boundsMax;
+        getSpriteBounds(record.transforms, boundsMin, boundsMax);
+
+        glm::ivec2 cellMin = glm::ivec2(glm::floor(boundsMin / OCCLUDER_GRID_CELL_SIZE));
+        glm::ivec2 cellMax = glm::ivec2(glm::floor(boundsMax / OCCLUDER_GRID_CELL_SIZE));
+
+        auto& transforms = record.transforms;
+        glm::mat2 spriteMatrix = glm::mat2(transforms.positionRight, transforms.positionUp);
+        float determinant = glm::determinant(spriteMatrix);
+
+        if (record.isBaked && abs(determinant) > EPSILON) {
+            nearbyOccluders.clear();
+            for (i32 y = cellMin.y; y <= cellMax.y; y++) {
+                for (i32 x = cellMin.x; x <= cellMax.x; x++) {
+                    auto it = occluderGrid.find(getOccluderGridCell(x, y));
+                    if (it != occluderGrid.end())
+                        nearbyOccluders.insert(nearbyOccluders.end(), it->second.begin(), it->second.end());
+                }
+            }
+
+            // The occluders drawn right after the sprite come first
+            std::sort(nearbyOccluders.begin(), nearbyOccluders.end());
+            nearbyOccluders.erase(std::unique(nearbyOccluders.begin(), nearbyOccluders.end()), nearbyOccluders.end());
+            if (nearbyOccluders.size() > MAX_OCCLUDERS_PER_SPRITE)
+                nearbyOccluders.resize(MAX_OCCLUDERS_PER_SPRITE);
+
+            glm::mat2 inverseSpriteMatrix = glm::inverse(spriteMatrix);
+
+            ConvexList mesh = record.mesh ? *record.mesh : quadMesh;
+            bool isTrimmed = false;
+
+            for (u32 occluderIndex : nearbyOccluders) {
+                auto& occluder = spriteRecords[occluderIndex];
+
+                glm::vec2 occluderMin, occluderMax;
+                getSpriteBounds(occluder.transforms, occluderMin, occluderMax);
+                if (glm::any(glm::lessThan(occluderMax, boundsMin)) || glm::any(glm::greaterThan(occluderMin, boundsMax)))
+                    continue;
+
+                auto& occluderTransforms = occluder.transforms;
+                glm::mat2 occluderMatrix = glm::mat2(occluderTransforms.positionRight, occluderTransforms.positionUp);
+
+                glm::mat2 matrix = inverseSpriteMatrix * occluderMatrix;
+                glm::vec2 offset = inverseSpriteMatrix * (occluderTransforms.positionBottomLeft - transforms.positionBottomLeft);
+
+                for (const auto& polygon : occluder.opaqueMesh->getPolygons()) {
+                    ConvexPolygon occluderPolygon = polygon.transformed(matrix, offset);
+                    if (!mesh.overlaps(occluderPolygon))
+                        continue;
+
+                    // Too many small pieces cost more to draw than they save
+                    ConvexList trimmed = mesh.subtract(occluderPolygon);
+                    if (trimmed.getPolygons().size() > MAX_TRIMMED_MESH_POLYGONS)
+                        continue;
+
+                    mesh = std::move(trimmed);
+                    isTrimmed = true;
+
+                    if (mesh.isEmpty())
+                        break;
+                }
+
+                if (mesh.isEmpty())
+                    break;
+            }
+
+            if (isTrimmed) {
+                if (mesh.isEmpty())
+                    removedSpriteCount++;
+                else
+                    trimmedSpriteCount++;
+                record.trimmedMesh = std::move(mesh);
+            }
+        }
+
+        if (record.isOccluder) {
+            for (i32 y = cellMin.y; y <= cellMax.y; y++) {
+                for (i32 x = cellMin.x; x <= cellMax.x; x++)
+                    occluderGrid[getOccluderGridCell(x, y)].push_back(i);
+            }
+        }
+    }
+}
+
+#define MERGE_POSITION_PRECISION 0.01f
+#define MERGE_ORDER_GRID_CELL_SIZE 128.0f
+
+/*
+    A merged quad raises the extent of its chunk (see
+    ObjectBatchChunk::extent) to about its own size, so
+    it is kept well below the width of a chunk.
+*/
+#define MAX_MERGED_QUAD_SIZE 240.0f
+
+/*
+    Sprites can only be merged when they have
+    the same size and look exactly the same.
+*/
+struct UniformSpriteMergeKey {
+    u16 colorChannel;
+    u32 uniformColor;
+    SpriteType type;
+    i32 width;
+    i32 height;
+
+    inline auto operator<=>(const UniformSpriteMergeKey&) const = default;
+};
+
+static u64 getMergeCell(i32 x, i32 y) {
+    return ((u64)(u32)x << 32) | (u64)(u32)y;
+}
+
+/*
+    The baked objects of every z-order of every sorter layer
+    are merged separately. These are next to each other after
+    sorting (see sortObjectsForChunking()).
+*/
+void ObjectBatch::mergeUniformSprites() {
+    mergedSpriteCount = 0;
+    mergedQuadCount   = 0;
+
+    u32 firstObject = 0;
+    while (firstObject < objectRecords.size()) {
+        GameObject* object = objectRecords[firstObject].object;
+        u32 sorterLayer = objectRecords[firstObject].sorterLayer;
+        i32 zOrder = object->getObjectZOrder();
+        bool isBaked = renderer.isObjectBaked(renderer.getObjectSRBIndex(object));
+
+        u32 objectCount = 1;
+        while (firstObject + objectCount < objectRecords.size()) {
+            GameObject* nextObject = objectRecords[firstObject + objectCount].object;
+            if (objectRecords[firstObject + objectCount].sorterLayer != sorterLayer)
+                break;
+            if (nextObject->getObjectZOrder() != zOrder)
+                break;
+            if (renderer.isObjectBaked(renderer.getObjectSRBIndex(nextObject)) != isBaked)
+                break;
+            objectCount++;
+        }
+
+        if (isBaked)
+            mergeUniformSpritesInRange(firstObject, objectCount);
+
+        firstObject += objectCount;
+    }
+}
+
+/*
+    Only objects that are a single uniform, axis aligned quad are
+    merged. Every group of these that look the same is put on a
+    grid with cells the size of the sprites. Then, rectangles of
+    cells are grown greedily, first along the x-axis and then along
+    the y-axis. Every rectangle is drawn as one quad that samples
+    a single texel, by the first sprite of the rectangle.
+
+    Drawing the whole rectangle in the place of its first sprite
+    moves the others back in the draw order. So a rectangle only
+    grows as long as no other sprite that is drawn between its
+    first and its last sprite overlaps it.
+*/
+void ObjectBatch::mergeUniformSpritesInRange(u32 firstObject, u32 objectCount) {
+    std::map<UniformSpriteMergeKey, std::vector<u32>> spritesPerKey;
+
+    // Every sprite of the range, to find the ones drawn in between the sprites of a rectangle
+    std::unordered_map<u64, std::vector<u32>> orderGrid;
+    auto& lastObjectRecord = objectRecords[firstObject + objectCount - 1];
+    u32 spriteEnd = lastObjectRecord.firstSprite + lastObjectRecord.spriteCount;
+
+    for (u32 i = objectRecords[firstObject].firstSprite; i < spriteEnd; i++) {
+        // Sprites that are fully occluded are not drawn
+        if (spriteRecords[i].trimmedMesh && spriteRecords[i].trimmedMesh->isEmpty())
+            continue;
+
+        glm::vec2 boundsMin, boundsMax;
+        getSpriteBounds(spriteRecords[i].transforms, boundsMin, boundsMax);
+
+        glm::ivec2 cellMin = glm::ivec2(glm::floor(boundsMin / MERGE_ORDER_GRID_CELL_SIZE));
+        glm::ivec2 cellMax = glm::ivec2(glm::floor(boundsMax / MERGE_ORDER_GRID_CELL_SIZE));
+        for (i32 y = cellMin.y; y <= cellMax.y; y++) {
+            for (i32 x = cellMin.x; x <= cellMax.x; x++)
+                orderGrid[getMergeCell(x, y)].push_back(i);
+        }
+    }
+
+    for (u32 i = firstObject; i < firstObject + objectCount; i++) {
+        auto& objectRecord = objectRecords[i];
+        if (objectRecord.spriteCount != 1)
+            continue;
+
+        auto& record = spriteRecords[objectRecord.firstSprite];
+        if (!record.uniformColor || record.mesh || record.trimmedMesh)
+            continue;
+
+        auto& transforms = record.transforms;
+        if (abs(transforms.positionRight.y) > EPSILON || abs(transforms.positionUp.x) > EPSILON)
+            continue;
+
+        glm::vec2 size = glm::abs(glm::vec2(transforms.positionRight.x, transforms.positionUp.y));
+        if (size.x < MERGE_POSITION_PRECISION || size.y < MERGE_POSITION_PRECISION)
+            continue;
+
+        UniformSpriteMergeKey key {
+            record.colorChannel,
+            record.uniformColor.value(),
+            record.type,
+            (i32)std::round(size.x / MERGE_POSITION_PRECISION),
+            (i32)std::round(size.y / MERGE_POSITION_PRECISION)
+        };
+
+        spritesPerKey[key].push_back(objectRecord.firstSprite);
+    }
+
+    for (auto& [key, sprites] : spritesPerKey) {
+        if (sprites.size() < 2)
+            continue;
+
+        glm::vec2 cellSize = glm::vec2(key.width, key.height) * MERGE_POSITION_PRECISION;
+
+        auto getSpriteMin = [&](u32 spriteIndex) {
+            auto& transforms = spriteRecords[spriteIndex].transforms;
+            return glm::min(
+                transforms.positionBottomLeft,
+                transforms.positionBottomLeft + transforms.positionRight + transforms.positionUp
+            );
+        };
+
+        glm::vec2 origin = getSpriteMin(sprites[0]);
+
+        std::unordered_map<u64, u32> spritePerCell;
+        std::vector<glm::ivec2> cells;
+
+        for (u32 spriteIndex : sprites) {
+            glm::vec2 cellPosition = (getSpriteMin(spriteIndex) - origin) / cellSize;
+            glm::ivec2 cell = glm::ivec2(glm::round(cellPosition));
+
+            // Sprites that are not on the grid are drawn on their own
+            if (glm::any(glm::greaterThan(glm::abs(glm::vec2(cell) - cellPosition) * cellSize, glm::vec2(MERGE_POSITION_PRECISION))))
+                continue;
+
+            if (spritePerCell.try_emplace(getMergeCell(cell.x, cell.y), spriteIndex).second)
+                cells.push_back(cell);
+        }
+
+        std::sort(cells.begin(), cells.end(), [](const glm::ivec2& a, const glm::ivec2& b) {
+            return a.y != b.y ? a.y < b.y : a.x < b.x;
+        });
+
+        // Whether the cell has a sprite that has not been merged yet
+        auto hasSprite = [&](i32 x, i32 y) {
+            return spritePerCell.contains(getMergeCell(x, y));
+        };
+
+        // Whether the sprite would be drawn by the rectangle
+        auto isInRectangle = [&](u32 spriteIndex, glm::ivec2 cell, i32 width, i32 height) {
+            glm::vec2 cellPosition = (getSpriteMin(spriteIndex) - origin) / cellSize;
+            glm::ivec2 spriteCell = glm::ivec2(glm::round(cellPosition));
+            if (spriteCell.x < cell.x || spriteCell.x >= cell.x + width || spriteCell.y < cell.y || spriteCell.y >= cell.y + height)
+                return false;
+
+            auto it = spritePerCell.find(getMergeCell(spriteCell.x, spriteCell.y));
+            return it != spritePerCell.end() && it->second == spriteIndex;
+        };
+
+        auto keepsDrawOrder = [&](glm::ivec2 cell, i32 width, i32 height) {
+            u32 firstSprite = UINT32_MAX;
+            u32 lastSprite  = 0;
+            for (i32 y = cell.y; y < cell.y + height; y++) {
+                for (i32 x = cell.x; x < cell.x + width; x++) {
+                    u32 spriteIndex = spritePerCell.at(getMergeCell(x, y));
+                    firstSprite = std::min(firstSprite, spriteIndex);
+                    lastSprite  = std::max(lastSprite, spriteIndex);
+                }
+            }
+
+            // Sprites that only touch the rectangle don't overlap it
+            glm::vec2 rectangleMin = origin + glm::vec2(cell) * cellSize + MERGE_POSITION_PRECISION;
+            glm::vec2 rectangleMax = origin + glm::vec2(cell + glm::ivec2(width, height)) * cellSize - MERGE_POSITION_PRECISION;
+
+            glm::ivec2 gridMin = glm::ivec2(glm::floor(rectangleMin / MERGE_ORDER_GRID_CELL_SIZE));
+            glm::ivec2 gridMax = glm::ivec2(glm::floor(rectangleMax / MERGE_ORDER_GRID_CELL_SIZE));
+            for (i32 y = gridMin.y; y <= gridMax.y; y++) {
+                for (i32 x = gridMin.x; x <= gridMax.x; x++) {
+                    auto it = orderGrid.find(getMergeCell(x, y));
+                    if (it == orderGrid.end())
+                        continue;
+
+                    for (u32 spriteIndex : it->second) {
+                        if (spriteIndex <= firstSprite || spriteIndex > lastSprite)
+                            continue;
+                        if (isInRectangle(spriteIndex, cell, width, height))
+                            continue;
+
+                        glm::vec2 boundsMin, boundsMax;
+                        getSpriteBounds(spriteRecords[spriteIndex].transforms, boundsMin, boundsMax);
+                        if (glm::all(glm::lessThan(boundsMin, rectangleMax)) && glm::all(glm::greaterThan(boundsMax, rectangleMin)))
+                            return false;
+                    }
+                }
+            }
+
+            return true;
+        };
+
+        i32 maxWidth  = std::max(1, (i32)(MAX_MERGED_QUAD_SIZE / cellSize.x));
+        i32 maxHeight = std::max(1, (i32)(MAX_MERGED_QUAD_SIZE / cellSize.y));
+
+        for (auto& cell : cells) {
+            if (!hasSprite(cell.x, cell.y))
+                continue;
+
+            i32 width = 1;
+            while (width < maxWidth && hasSprite(cell.x + width, cell.y) && keepsDrawOrder(cell, width + 1, 1))
+                width++;
+
+            i32 height = 1;
+            for (; height < maxHeight; height++) {
+                bool isRowFull = true;
+                for (i32 x = cell.x; x < cell.x + width && isRowFull; x++)
+                    isRowFull = hasSprite(x, cell.y + height);
+                if (!isRowFull || !keepsDrawOrder(cell, width, height + 1))
+                    break;
+            }
+
+            // The sprite that is drawn first draws the whole rectangle
+            u32 firstSprite = UINT32_MAX;
+            for (i32 y = cell.y; y < cell.y + height; y++) {
+                for (i32 x = cell.x; x < cell.x + width; x++) {
+                    auto it = spritePerCell.find(getMergeCell(x, y));
+                    firstSprite = std::min(firstSprite, it->second);
+                    spriteRecords[it->second].isMerged = true;
+                    spritePerCell.erase(it);
+                }
+            }
+
+            if (width * height == 1) {
+                spriteRecords[firstSprite].isMerged = false;
+                continue;
+            }
+
+            auto& record = spriteRecords[firstSprite];
+            auto& transforms = record.transforms;
+            record.isMerged = false;
+
+            transforms.texCoordBottomLeft += (transforms.texCoordRight + transforms.texCoordUp) * 0.5f;
+            transforms.texCoordRight = glm::vec2(0, 0);
+            transforms.texCoordUp    = glm::vec2(0, 0);
+
+            transforms.positionBottomLeft = origin + glm::vec2(cell) * cellSize;
+            transforms.positionRight = glm::vec2(cellSize.x * width, 0);
+            transforms.positionUp    = glm::vec2(0, cellSize.y * height);
+
+            mergedSpriteCount += width * height;
+            mergedQuadCount++;
+        }
+    }
+}
+
+void ObjectBatch::addObjectToChunks(
+    GameObject* object,
+    u32 firstIndex, u32 indexCount,
+    u32 firstOpaqueIndex, u32 opaqueIndexCount,
+    float extent
+) {
+    if (indexCount == 0)
+        return;
+
+    glm::vec2 position = ccPointToGLM(object->m_startPosition);
+    usize srbIndex = renderer.getObjectSRBIndex(object);
+    auto groupCombIndex = renderer.getGroupCombinationIndex(srbIndex);
+    bool isBaked = renderer.isObjectBaked(srbIndex);
+
+    shaderFeatures |= renderer.getObjectShaderFeatures(srbIndex);
+
+    if (!chunks.empty()) {
+        auto& chunk = chunks.back();
+
+        // The group combinations of baked objects are static, so their states are all the same
+        bool canExtend =
+            chunk.isBaked == isBaked &&
+            (isBaked || chunk.groupCombinationIndex == groupCombIndex) &&
+            chunk.firstIndex + chunk.indexCount == firstIndex &&
+            chunk.objectCount < MAX_OBJECTS_PER_CHUNK &&
+            std::max(chunk.boundsMax.x, position.x) - std::min(chunk.boundsMin.x, position.x) <= MAX_CHUNK_WIDTH;
+
+        if (canExtend) {
+            chunk.indexCount += indexCount;
+            chunk.opaqueIndexCount += opaqueIndexCount;
+            chunk.objectCount++;
+            chunk.boundsMin = glm::min(chunk.boundsMin, position);
+            chunk.boundsMax = glm::max(chunk.boundsMax, position);
+            chunk.extent    = std::max(chunk.extent, extent);
+            return;
+        }
+    }
+
+    chunks.push_back({
+        firstIndex,
+        indexCount,
+        firstOpaqueIndex,
+        opaqueIndexCount,
+        groupCombIndex,
+        1,
+        isBaked,
+        position,
+        position,
+        extent
+    });
+}
+
+void ObjectBatch::finishWriting() {
+    shaderFeatures = 0;
+
+    sortObjectsForChunking();
+
+    for (auto [object, sorterLayer] : objects)
+        collectGameObject(object, sorterLayer);
+    objects.clear();
+    objects.shrink_to_fit();
+
+    if (renderer.isUseOcclusionTrimming())
+        trimOccludedSprites();
+
+    if (renderer.isUseSpriteMerging())
+        mergeUniformSprites();
+
+    chunks.clear();
+
+    // The points of a quad, in the order of the QUAD_* indicies
+    if (renderer.isUseVertexPulling())
+        meshPoints = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+
+    writtenSpriteCount = 0;
+    shaderSpriteCount  = 0;
+    for (auto& record : objectRecords)
+        writeGameObject(record);
+    objectRecords.clear();
+    objectRecords.shrink_to_fit();
+    spriteRecords.clear();
+    spriteRecords.shrink_to_fit();
+
+    generateDrawLists();
 
     storeGLStates();
 
@@ -218,63 +954,185 @@ void ObjectBatch::finishWriting() {
         vertexBuffer = nullptr;
     }
 
+    if (spriteBuffer) {
+        Buffer::destroy(spriteBuffer);
+        spriteBuffer = nullptr;
+    }
+
+    if (meshPointBuffer) {
+        Buffer::destroy(meshPointBuffer);
+        meshPointBuffer = nullptr;
+    }
+
     if (indexBuffer) {
         Buffer::destroy(indexBuffer);
         indexBuffer = nullptr;
     }
 
-    vertexCount = verticies.size();
-    indexCount  = indicies.size();
+    indexCount = indicies.size();
 
+    // The opaque indicies are put after all other indicies
+    for (auto& chunk : chunks)
+        chunk.firstOpaqueIndex += indexCount;
+    indicies.insert(indicies.end(), opaqueIndicies.begin(), opaqueIndicies.end());
 
-
-    vertexBuffer = Buffer::createStaticDraw(verticies.data(), vertexCount * sizeof(ObjectVertex));
-    // if (renderer.isUseIndexCulling()) {
-    //     culledIndicies.resize(quadCount);
-        indexBuffer = Buffer::createStaticDraw(indicies.data(), indexCount * sizeof(u32));
-    // } else {
-    //     indexBuffer = Buffer::createStaticDraw(indicies.data(), indicies.size() * sizeof(ObjectIndicies));
-    //     indicies.clear();
-    // }
+    if (renderer.isUseVertexPulling()) {
+        depthOrderCount = pulledSprites.size();
+        spriteBuffer    = Buffer::createStaticDraw(pulledSprites.data(), pulledSprites.size() * sizeof(ObjectSprite));
+        meshPointBuffer = Buffer::createStaticDraw(meshPoints.data(), meshPoints.size() * sizeof(glm::vec2));
+    } else {
+        depthOrderCount = verticies.size();
+        vertexBuffer    = Buffer::createStaticDraw(verticies.data(), verticies.size() * sizeof(ObjectVertex));
+    }
+    indexBuffer = Buffer::createStaticDraw(indicies.data(), indicies.size() * sizeof(u32));
 
     indicies.clear();
+    opaqueIndicies.clear();
     verticies.clear();
+    pulledSprites.clear();
+    pulledSprites.shrink_to_fit();
+    meshPoints.clear();
+    meshPoints.shrink_to_fit();
+    meshPointRanges.clear();
     
     prepareVAO();
     restoreGLStates();
 }
 
-usize ObjectBatch::generateCulledIndicies() {
-//    if (renderer.isPaused())
-//        return prevCulledIndiciesCount;
-//
-//    usize outIndex = 0;
-//
-//    for (usize i = 0; i < quadCount; i++) {
-//        if (!renderer.isObjectInView(quadsSrbIndicies[i]))
-//            continue;
-//
-//        culledIndicies[outIndex] = indicies[i];
-//        outIndex++;
-//    }
-//
-//    indexBuffer->write(culledIndicies.data(), outIndex * sizeof(ObjectIndicies));
-//    prevCulledIndiciesCount = outIndex * INDICIES_PER_QUAD;
-//    return outIndex * INDICIES_PER_QUAD;
-    return 0;
+void ObjectBatch::generateDrawLists() {
+    drawLists.clear();
+
+    for (u32 i = 0; i < chunks.size(); i++) {
+        if (!drawLists.empty() && drawLists.back().isBaked == chunks[i].isBaked) {
+            drawLists.back().chunkCount++;
+            drawLists.back().indexCount += chunks[i].indexCount;
+            continue;
+        }
+
+        drawLists.push_back({ chunks[i].isBaked, i, 1, chunks[i].indexCount, 0, 0 });
+    }
+}
+
+u32 ObjectBatch::getObjectShaderVariant(const ObjectBatchDrawList& drawList) const {
+    u32 variant = renderer.isUseVertexPulling() ? OBJECT_SHADER_VERTEX_PULLING : 0;
+
+    // Baked objects don't read the DRB
+    if (drawList.isBaked)
+        return variant | OBJECT_SHADER_BAKED;
+
+    if (renderer.isUseDrbUniformBuffer())
+        variant |= OBJECT_SHADER_DRB_UNIFORM_BUFFER;
+
+    if (renderer.isUseObjectResolvePass())
+        return variant | OBJECT_SHADER_RESOLVED_OBJECTS | (shaderFeatures & ~OBJECT_SHADER_RESOLVED_FEATURES);
+    return variant | shaderFeatures;
+}
+
+usize ObjectBatch::generateCulledIndicies(const ObjectBatchDrawList& drawList, bool cullOutOfView, bool opaquePass) {
+    drawCounts.clear();
+    drawOffsets.clear();
+
+    usize totalIndexCount = 0;
+    u32 prevChunkEnd = UINT32_MAX;
+
+    for (u32 i = 0; i < drawList.chunkCount; i++) {
+        u32 chunkIndex = opaquePass ? drawList.chunkCount - 1 - i : i;
+        auto& chunk = chunks[drawList.firstChunk + chunkIndex];
+
+        u32 firstIndex = opaquePass ? chunk.firstOpaqueIndex : chunk.firstIndex;
+        u32 count      = opaquePass ? chunk.opaqueIndexCount : chunk.indexCount;
+
+        if (count == 0 || renderer.isChunkHidden(chunk))
+            continue;
+        if (cullOutOfView && !renderer.isChunkInView(chunk))
+            continue;
+
+        if (!opaquePass && firstIndex == prevChunkEnd)
+            drawCounts.back() += count;
+        else {
+            drawCounts.push_back(count);
+            drawOffsets.push_back((const void*)(firstIndex * sizeof(u32)));
+        }
+
+        prevChunkEnd = firstIndex + count;
+        totalIndexCount += count;
+    }
+
+    return totalIndexCount;
+}
+
+usize ObjectBatch::drawChunks(const ObjectBatchDrawList& drawList, bool opaquePass) {
+    /*
+        The draw commands have been generated by Renderer::cullChunksOnGPU().
+        The commands of the opaque pass are front to back, like below.
+    */
+    if (renderer.isUseGPUCulling()) {
+        u32 firstCommand  = drawList.gpuFirstCommand;
+        u32 drawListIndex = drawList.gpuDrawListIndex;
+
+        // The commands of the opaque pass come after all other commands
+        if (opaquePass) {
+            firstCommand  += renderer.getGPUChunkCount();
+            drawListIndex += renderer.getGPUDrawListCount();
+        }
+
+        auto commands = (const void*)(firstCommand * sizeof(DrawElementsIndirectCommand));
+
+        if (glext::multiDrawElementsIndirectCount) {
+            glext::multiDrawElementsIndirectCount(
+                GL_TRIANGLES, GL_UNSIGNED_INT, commands,
+                drawListIndex * sizeof(u32), drawList.chunkCount, 0
+            );
+        } else
+            glext::multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, commands, drawList.chunkCount, 0);
+
+        // The amount of visible sprites is only known by the GPU, so this is the most it can draw
+        return drawList.indexCount / INDICIES_PER_QUAD;
+    }
+
+    // Hidden chunks are always skipped, even without index culling
+    usize culledIndexCount = generateCulledIndicies(drawList, renderer.isUseIndexCulling(), opaquePass);
+    if (culledIndexCount == 0)
+        return 0;
+
+    glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(), drawCounts.size());
+    return culledIndexCount / INDICIES_PER_QUAD;
 }
 
 usize ObjectBatch::draw() {
+    if (indexCount == 0)
+        return 0;
+
     bind();
-//    usize indiciesCount = indexCount();
-//    if (renderer.isUseIndexCulling())
-//        indiciesCount = generateCulledIndicies();
-//
-//    if (indiciesCount == 0)
-//        return 0;
-
-    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
-    return indexCount / INDICIES_PER_QUAD;
+
+    if (renderer.isUseDepthPass()) {
+        renderer.beginOpaquePass();
+
+        for (auto it = drawLists.rbegin(); it != drawLists.rend(); it++) {
+            u32 variant = getObjectShaderVariant(*it) | OBJECT_SHADER_OPAQUE_PASS;
+            auto shader = renderer.useObjectShader(variant);
+            if (!shader)
+                continue;
+
+            shader->setUInt("u_depthOrderOffset", depthOrderOffset);
+            drawChunks(*it, true);
+        }
+
+        renderer.beginTranslucentPass();
+    }
+
+    usize spriteCount = 0;
+    for (auto& drawList : drawLists) {
+        u32 variant = getObjectShaderVariant(drawList);
+        auto shader = renderer.useObjectShader(variant);
+        if (!shader)
+            continue;
+
+        shader->setUInt("u_depthOrderOffset", depthOrderOffset);
+        spriteCount += drawChunks(drawList, false);
+    }
+
+    return spriteCount;
 }
 
 struct AttribTypeInfo {
@@ -320,6 +1178,10 @@ void ObjectBatch::prepareVAO() {
     if (vao == 0)
         glGenVertexArrays(1, &vao);
 
+    // The object shader has no vertex attributes with vertex pulling
+    if (renderer.isUseVertexPulling())
+        return;
+
     glBindVertexArray(vao);
     vertexBuffer->bindAs(GL_ARRAY_BUFFER);
 
@@ -6,10 +6,15 @@
 #include <vector>
 
 #include "Buffer.hpp"
+#include "GroupManager.hpp"
 #include "Geode/cocos/textures/CCTexture2D.h"
 #include "ObjectSpriteUnpacker.hpp"
+#include "ShaderSpriteManager.hpp"
 #include "glm/fwd.hpp"
 #include "math/ConvexList.hpp"
+#include "../../resources/shaders/shared.h"
+#include <optional>
+#include <unordered_map>
 
 using namespace geode;
 
@@ -24,6 +29,8 @@ using namespace geode;
     NOTE: The positionOffset attribute is this
           vertex' offset from the position of
           the object this sprite belongs to.
+          For baked objects, it is the position
+          of the vertex in world space.
 */
 #define OBJECT_VERTEX_ATTRIBUTES(ATTRIB) \
     ATTRIB(0, vec2, positionOffset) \
@@ -61,6 +68,62 @@ struct ObjectIndicies {
     u32 indicies[INDICIES_PER_QUAD];
 };
 
+/*
+    A batch is partitioned into chunks of objects that
+    are next to each other on the x-axis and share the
+    same group combination. Every chunk is a contiguous
+    range in the index buffer, so the chunks that are
+    in view can be drawn with a single multi-draw.
+
+    Baked objects (see Renderer::isObjectBaked()) never
+    move, so they only share chunks with other baked
+    objects, no matter their group combination.
+
+    With the depth pass, every chunk also has a range of
+    indicies that is drawn in the opaque pass. These come
+    after the indicies of all chunks in the index buffer.
+*/
+#define MAX_OBJECTS_PER_CHUNK 64
+#define MAX_CHUNK_WIDTH       480.0f
+
+struct ObjectBatchChunk {
+    u32 firstIndex;
+    u32 indexCount;
+    u32 firstOpaqueIndex;
+    u32 opaqueIndexCount;
+    GroupCombinationIndex groupCombinationIndex;
+    u32 objectCount;
+    bool isBaked;
+
+    // Bounds of the start positions of the objects in this chunk
+    glm::vec2 boundsMin;
+    glm::vec2 boundsMax;
+
+    /*
+        The maximum distance of a vertex from the position
+        of its object. Objects rotate around their own
+        position, so this stays the same no matter the
+        local transform.
+    */
+    float extent;
+};
+
+/*
+    A range of chunks that are all baked or all not
+    baked. Every draw list is drawn with its own shader.
+*/
+struct ObjectBatchDrawList {
+    bool isBaked;
+    u32 firstChunk;
+    u32 chunkCount;
+    // Of all the chunks, the most the GPU culling pass can draw
+    u32 indexCount;
+
+    // Where the draw commands of this list are in the GPU culling pass
+    u32 gpuDrawListIndex;
+    u32 gpuFirstCommand;
+};
+
 ////////////////////////////////////////////////
 
 class Renderer;
@@ -74,6 +137,48 @@ struct SpriteVertexTransforms {
     glm::vec2 texCoordUp;
 };
 
+/*
+    The sprites of a batch are collected before any of them
+    are written, so sprites that are covered by sprites drawn
+    after them can be trimmed first (see trimOccludedSprites()).
+*/
+struct ObjectSpriteRecord {
+    SpriteVertexTransforms transforms;
+    glm::vec2 objectStartPosition;
+
+    // This is nullptr when the sprite is a quad
+    ConvexList* mesh;
+    ConvexList* opaqueMesh;
+
+    u32 srbIndex;
+    u16 colorChannel;
+    u8  spriteSheet;
+    SpriteType type;
+    bool isBaked;
+
+    // Whether this sprite always fully covers whatever is behind its opaque mesh
+    bool isOccluder;
+
+    // The part of the mesh that is not covered, set by trimOccludedSprites()
+    std::optional<ConvexList> trimmedMesh;
+
+    // The color of the frame, if it is uniform (see UniformSpriteDictionary)
+    std::optional<u32> uniformColor;
+
+    // Set by mergeUniformSprites() when this sprite is drawn by another record
+    bool isMerged;
+
+    ShaderSprite shaderSprite;
+};
+
+struct ObjectRecord {
+    GameObject* object;
+    // The index of the ObjectSorter layer of the object
+    u32 sorterLayer;
+    u32 firstSprite;
+    u32 spriteCount;
+};
+
 class ObjectBatch : public ObjectSpriteUnpackerDelegate {
 public:
     inline ObjectBatch(Renderer& renderer)
@@ -86,18 +191,28 @@ public:
         SpriteSheet spriteSheet
     );
 
-    void prepareSpriteMeshWrite(
-        GameObject* parentObject,
-        cocos2d::CCSprite* sprite,
-        SpriteType type,
-        const cocos2d::CCAffineTransform& transform
-    );
+    void prepareSpriteMeshWrite(const ObjectSpriteRecord& record);
 
     void writeSpriteVertex(glm::vec2 pos);
     void writeSpriteIndex(u32 index);
 
     void writeSpriteMeshFromConvexList(const ConvexList& list);
 
+    void writeOpaqueSpriteMesh(const ObjectSpriteRecord& record, u32 firstSpriteIndex);
+
+    void writeSprite(const ObjectSpriteRecord& record);
+
+    // Adds the ObjectSprite of the record and returns its index
+    u32 pushPulledSprite(const ObjectSpriteRecord& record, u32 firstMeshPoint);
+
+    // The first point and point count of the mesh in the mesh point buffer
+    std::pair<u32, u32> getMeshPointRange(const ConvexList& mesh);
+
+    // The mesh is nullptr for a quad
+    void writePulledSpriteMesh(const ObjectSpriteRecord& record, const ConvexList* mesh, std::vector<u32>& indexList);
+
+    void writePulledSprite(const ObjectSpriteRecord& record);
+
     void receiveUnpackedSprite(
         GameObject* parentObject,
         cocos2d::CCSprite* sprite,
@@ -105,32 +220,110 @@ public:
         const cocos2d::CCAffineTransform& transform
     ) override;
 
-    void writeGameObject(GameObject* object);
+    inline void addGameObject(GameObject* object, u32 sorterLayer) {
+        objects.push_back({ object, sorterLayer });
+    }
+
+    void collectGameObject(GameObject* object, u32 sorterLayer);
+
+    void writeGameObject(const ObjectRecord& record);
 
     void finishWriting();
 
     inline void bind() {
         glBindVertexArray(vao);
         indexBuffer->bindAs(GL_ELEMENT_ARRAY_BUFFER);
+
+        if (spriteBuffer) {
+            spriteBuffer->bindAsStorageBuffer(OBJECT_SPRITE_BUFFER_BINDING);
+            meshPointBuffer->bindAsStorageBuffer(SPRITE_MESH_POINT_BUFFER_BINDING);
+        }
+    }
+
+    // With vertex pulling, this is the size of the sprite and mesh point buffers
+    inline usize getVertexBufferSize() const {
+        usize size = 0;
+        if (vertexBuffer)    size += vertexBuffer->getSize();
+        if (spriteBuffer)    size += spriteBuffer->getSize();
+        if (meshPointBuffer) size += meshPointBuffer->getSize();
+        return size;
+    }
+
+    inline usize getChunkCount() const {
+        return chunks.size();
     }
 
-    // inline u32 indexCount() {
-    //     return quadCount * 6;
-    // }
+    /*
+        The amount of steps in the draw order of the depth pass.
+        Every vertex is a step, or every sprite with vertex pulling.
+    */
+    inline u32 getDepthOrderCount() const {
+        return depthOrderCount;
+    }
+
+    // The amount of sprites that have been partly or fully trimmed by trimOccludedSprites()
+    inline usize getTrimmedSpriteCount() const { return trimmedSpriteCount; }
+    inline usize getRemovedSpriteCount() const { return removedSpriteCount; }
+
+    // The amount of sprites that have been merged into bigger quads by mergeUniformSprites()
+    inline usize getMergedSpriteCount() const { return mergedSpriteCount; }
+    inline usize getMergedQuadCount() const { return mergedQuadCount; }
+
+    inline usize getWrittenSpriteCount() const { return writtenSpriteCount; }
+    inline usize getShaderSpriteCount() const { return shaderSpriteCount; }
+
+    // The amount of draw order steps before this batch, used for the depth of its vertices
+    inline void setDepthOrderOffset(u32 offset) {
+        depthOrderOffset = offset;
+    }
+
+    inline const std::vector<ObjectBatchChunk>& getChunks() const {
+        return chunks;
+    }
 
-    inline usize getQuadCount() {
-        return quadCount;
+    inline std::vector<ObjectBatchDrawList>& getDrawLists() {
+        return drawLists;
     }
 
+    // The object shader variant a draw list is drawn with, without the pass flag
+    u32 getObjectShaderVariant(const ObjectBatchDrawList& drawList) const;
+
     inline void setSpriteSheetFilter(SpriteSheet sheet) {
         spriteSheetFilter = sheet;
     }
 
-    usize generateCulledIndicies();
+    /*
+        Fills drawCounts and drawOffsets with the index ranges of
+        the chunks in a draw list that are not hidden and, if
+        cullOutOfView is set, in view. Adjacent visible chunks are
+        merged into one range. For the opaque pass, the opaque index
+        ranges are used in reverse order (front to back) and are not
+        merged. Returns the total index count.
+    */
+    usize generateCulledIndicies(const ObjectBatchDrawList& drawList, bool cullOutOfView, bool opaquePass);
 
     usize draw();
 
 private:
+    usize drawChunks(const ObjectBatchDrawList& drawList, bool opaquePass);
+
+    void sortObjectsForChunking();
+
+    void trimOccludedSprites();
+
+    void mergeUniformSprites();
+
+    void mergeUniformSpritesInRange(u32 firstObject, u32 objectCount);
+
+    void addObjectToChunks(
+        GameObject* object,
+        u32 firstIndex, u32 indexCount,
+        u32 firstOpaqueIndex, u32 opaqueIndexCount,
+        float extent
+    );
+
+    void generateDrawLists();
+
     void prepareVAO();
 
 private:
@@ -139,29 +332,58 @@ private:
 
     SpriteSheet spriteSheetFilter = (SpriteSheet)-1;
 
-    // This is only used when writing. After writing, it is cleared.
-    std::vector<ObjectQuad> quads;
-    usize currentQuadIndex = 0;
-    usize prevCulledIndiciesCount = 0;
+    // These are only used when writing. After writing, they are cleared.
+    std::vector<std::pair<GameObject*, u32>> objects;
+    std::vector<ObjectRecord> objectRecords;
+    std::vector<ObjectSpriteRecord> spriteRecords;
 
     Buffer* vertexBuffer = nullptr;
     Buffer* indexBuffer = nullptr;
 
-    std::vector<u32> quadsSrbIndicies;
-    std::vector<ObjectIndicies> culledIndicies;
+    // Used instead of the vertex buffer with vertex pulling
+    Buffer* spriteBuffer = nullptr;
+    Buffer* meshPointBuffer = nullptr;
+
+    std::vector<ObjectBatchChunk> chunks;
+    std::vector<ObjectBatchDrawList> drawLists;
+
+    // These are regenerated every frame by generateCulledIndicies()
+    std::vector<i32>         drawCounts;
+    std::vector<const void*> drawOffsets;
 
     u32 vao = 0;
-    u32 quadCount = 0;
 
     std::vector<u32> indicies;
+    std::vector<u32> opaqueIndicies;
     std::vector<ObjectVertex> verticies;
-    u32 vertexCount = 0;
-    u32 indexCount  = 0;
+    u32 indexCount = 0;
+
+    // These are only used when writing with vertex pulling
+    std::vector<ObjectSprite> pulledSprites;
+    std::vector<glm::vec2> meshPoints;
+    std::unordered_map<const ConvexList*, std::pair<u32, u32>> meshPointRanges;
+
+    u32 depthOrderCount = 0;
+
+    u32 depthOrderOffset = 0;
+
+    // The OBJECT_SHADER_FEATURE_* flags used by the objects that are not baked
+    u32 shaderFeatures = 0;
+
+    usize trimmedSpriteCount = 0;
+    usize removedSpriteCount = 0;
+    usize mergedSpriteCount = 0;
+    usize mergedQuadCount = 0;
+    usize writtenSpriteCount = 0;
+    usize shaderSpriteCount = 0;
 
     SpriteVertexTransforms currentSpriteVertexTransforms;
     glm::vec2 currentSpriteObjectStartPosition;
+    bool currentSpriteIsBaked;
+    float currentObjectExtent;
     u32 currentSpriteVertexIndex;
     u32 currentSpriteSRBIndex;
     u16 currentSpriteColorChannel;
     u8  currentSpriteSpriteSheet;
+    ShaderSprite currentSpriteShaderSprite;
 };
\ No newline at end of file
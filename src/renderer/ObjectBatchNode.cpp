@@ -11,11 +11,27 @@ bool ObjectBatchNode::init(SpriteSheet spriteSheet) {
 }
 
 void ObjectBatchNode::draw() {
-    auto shader = renderer.prepareDraw();
+    if (timerName.empty())
+        timerName = fmt::format("Batch node z{} (sheet {})", getZOrder(), (i32)spriteSheet);
 
-    shader->setTexture("u_spriteSheet", 0, spriteSheetTexture);
+    u64 beginTime = getTime();
 
-    batch.draw();
+    auto& gpuTimer = renderer.getGPUTimer();
+    gpuTimer.begin(timerName);
+
+    renderer.prepareDraw();
+
+    // Every object shader variant samples u_spriteSheet from texture unit 0
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, spriteSheetTexture->getName());
+
+    auto& metrics = renderer.getMetrics();
+    metrics.add(renderer.spritesOnScreenMetric, batch.draw());
 
     renderer.finishDraw();
+
+    gpuTimer.end();
+
+    metrics.add(renderer.batchNodeDrawsMetric);
+    metrics.record(renderer.batchNodeDrawTimeMetric, getTime() - beginTime);
 }
\ No newline at end of file
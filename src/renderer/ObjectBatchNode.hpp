@@ -13,14 +13,16 @@ public:
 
     void draw() override;
 
-    inline void addGameObject(GameObject* object) {
-        batch.writeGameObject(object);
+    inline void addGameObject(GameObject* object, u32 sorterLayer) {
+        batch.addGameObject(object, sorterLayer);
     }
 
     inline void generateBatch() {
         batch.finishWriting();
     }
 
+    inline ObjectBatch& getBatch() { return batch; }
+
 public:
     static inline Ref<ObjectBatchNode> create(Renderer& renderer, SpriteSheet spriteSheet) {
         auto ret = new ObjectBatchNode(renderer);
@@ -38,4 +40,7 @@ private:
 
     SpriteSheet spriteSheet;
     cocos2d::CCTexture2D* spriteSheetTexture;
+
+    // The name of this node in the GPU timer results
+    std::string timerName;
 };
\ No newline at end of file
@@ -39,6 +39,9 @@ public:
 
         inline ObjectBatchLayer& getLayer() const { return sorter.layers[layerIndex]; }
 
+        // The layers are drawn in the order of their indices
+        inline u32 getLayerIndex() const { return layerIndex; }
+
     private:
         void skipLayers();
 
@@ -60,7 +60,8 @@ void OverdrawView::predraw() {
     if (!enabled) return;
     glEnable(GL_STENCIL_TEST);
     glStencilFunc(GL_ALWAYS, 0, 0);
-    glStencilOp(GL_KEEP, GL_INCR, GL_INCR);
+    // Fragments rejected by the depth test of the depth pass are not drawn
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     stencilEnabled = true;
 }
@@ -81,6 +82,9 @@ void OverdrawView::clear() {
 
 void OverdrawView::finish() {
     if (!enabled) return;
+
+    auto& gpuTimer = renderer.getGPUTimer();
+    gpuTimer.begin("Overdraw view");
     
     auto currentSize = CCDirector::get()->getOpenGLView()->getWindowedSize();
     stencilBuffer.resize((u32)currentSize.width * (u32)currentSize.height);
@@ -128,6 +132,8 @@ void OverdrawView::finish() {
 
     drawFullscreenQuad();
 
+    gpuTimer.end();
+
     restoreGLStates();
 }
 
@@ -0,0 +1,213 @@
+#include "ProgramCache.hpp"
+#include "GLExtensions.hpp"
+
+#include <Geode/Geode.hpp>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+using namespace geode;
+
+// Bump this when the layout of the cache files changes
+#define PROGRAM_CACHE_MAGIC 0x31504742 // "BGP1"
+
+/*
+    Every object shader variant is its own entry,
+    so this has to hold the variants of a few levels.
+*/
+#define MAX_CACHED_PROGRAMS 64
+
+namespace programcache {
+
+struct ProgramCacheHeader {
+    u32 magic;
+    u32 binaryFormat;
+    u32 binaryLength;
+};
+
+static bool isSupported() {
+    if (!glext::supportsProgramBinaries())
+        return false;
+
+    i32 formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    return formatCount > 0;
+}
+
+static fs::path getCacheDir() {
+    return Mod::get()->getSaveDir() / "program-cache";
+}
+
+static fs::path getCachePath(ProgramKey key) {
+    return getCacheDir() / fmt::format("{:016x}.bin", key);
+}
+
+// 64-bit FNV-1a
+static void hashBytes(u64& hash, const void* data, usize size) {
+    auto bytes = (const u8*)data;
+    for (usize i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+}
+
+static void hashString(u64& hash, std::string_view string) {
+    hashBytes(hash, string.data(), string.size());
+
+    // Keeps "ab" + "c" and "a" + "bc" apart
+    u8 separator = 0;
+    hashBytes(hash, &separator, 1);
+}
+
+ProgramKey getKey(std::initializer_list<std::string_view> sources) {
+    u64 hash = 0xcbf29ce484222325;
+
+    for (auto source : sources)
+        hashString(hash, source);
+
+    auto renderer = (const char*)glGetString(GL_RENDERER);
+    auto version  = (const char*)glGetString(GL_VERSION);
+    hashString(hash, renderer ? renderer : "");
+    hashString(hash, version ? version : "");
+
+    return hash;
+}
+
+static void removeEntry(const fs::path& path) {
+    std::error_code error;
+    fs::remove(path, error);
+}
+
+u32 load(ProgramKey key) {
+    if (!isSupported())
+        return 0;
+
+    auto path = getCachePath(key);
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return 0;
+
+    std::error_code error;
+    u64 fileSize = fs::file_size(path, error);
+    if (error)
+        fileSize = 0;
+
+    ProgramCacheHeader header {};
+    file.read((char*)&header, sizeof(header));
+
+    // A corrupt or truncated entry must not make this allocate its length
+    std::vector<u8> binary;
+    bool isLengthValid = fileSize >= sizeof(header) && header.binaryLength <= fileSize - sizeof(header);
+    if (file && header.magic == PROGRAM_CACHE_MAGIC && isLengthValid) {
+        binary.resize(header.binaryLength);
+        file.read((char*)binary.data(), binary.size());
+    }
+
+    bool isValid = file && !binary.empty();
+    file.close();
+
+    if (!isValid) {
+        log::warn("Removing corrupted program cache entry {:016x}", key);
+        removeEntry(path);
+        return 0;
+    }
+
+    u32 program = glCreateProgram();
+    glext::programBinary(program, header.binaryFormat, binary.data(), binary.size());
+
+    i32 success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        log::info("Driver rejected program cache entry {:016x}, recompiling", key);
+        glDeleteProgram(program);
+        removeEntry(path);
+        return 0;
+    }
+
+    // The entries used the least recently are evicted first
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+
+    return program;
+}
+
+void prepareForSave(u32 program) {
+    if (isSupported())
+        glext::programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+static void evictOldEntries() {
+    std::error_code error;
+    std::vector<std::pair<fs::file_time_type, fs::path>> entries;
+
+    for (auto& entry : fs::directory_iterator(getCacheDir(), error)) {
+        if (entry.path().extension() != ".bin")
+            continue;
+
+        auto time = entry.last_write_time(error);
+        if (!error)
+            entries.push_back({ time, entry.path() });
+    }
+
+    if (entries.size() <= MAX_CACHED_PROGRAMS)
+        return;
+
+    std::sort(entries.begin(), entries.end());
+
+    for (usize i = 0; i < entries.size() - MAX_CACHED_PROGRAMS; i++)
+        removeEntry(entries[i].second);
+}
+
+void save(ProgramKey key, u32 program) {
+    if (!isSupported())
+        return;
+
+    i32 length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<u8> binary(length);
+    GLenum binaryFormat = 0;
+    glext::getProgramBinary(program, length, &length, &binaryFormat, binary.data());
+    if (length <= 0)
+        return;
+
+    std::error_code error;
+    fs::create_directories(getCacheDir(), error);
+    if (error) {
+        log::warn("Could not create the program cache directory: {}", error.message());
+        return;
+    }
+
+    ProgramCacheHeader header {
+        .magic        = PROGRAM_CACHE_MAGIC,
+        .binaryFormat = binaryFormat,
+        .binaryLength = (u32)length
+    };
+
+    // Written to a temporary file first, so a crash never leaves a half written entry
+    auto path = getCachePath(key);
+    auto temporaryPath = fs::path(path).replace_extension(".tmp");
+
+    std::ofstream file(temporaryPath, std::ios::binary);
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)binary.data(), length);
+    file.close();
+
+    if (!file) {
+        log::warn("Could not write program cache entry {:016x}", key);
+        removeEntry(temporaryPath);
+        return;
+    }
+
+    fs::rename(temporaryPath, path, error);
+    if (error) {
+        removeEntry(temporaryPath);
+        return;
+    }
+
+    evictOldEntries();
+}
+
+}
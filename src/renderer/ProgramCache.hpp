@@ -0,0 +1,40 @@
+#pragma once
+
+#include <common.hpp>
+#include <string_view>
+#include <initializer_list>
+
+/*
+    Compiling and linking the object shader takes a while on
+    some drivers, and it happens every time a level is entered.
+
+    So linked programs are saved to the save directory of the
+    mod with glGetProgramBinary and loaded back with
+    glProgramBinary. A program is keyed by a hash of its final
+    preprocessed sources, the GPU and the driver version, so
+    a changed shader or driver update never loads a stale binary.
+
+    A driver can still reject a binary (for example after an
+    update that kept the same version string). The entry is
+    then deleted and the program is compiled again.
+*/
+
+namespace programcache {
+
+using ProgramKey = u64;
+
+ProgramKey getKey(std::initializer_list<std::string_view> sources);
+
+/*
+    Returns the linked program saved for the key,
+    or 0 when there is none or the driver rejected it.
+*/
+u32 load(ProgramKey key);
+
+// Must be called before linking for save() to work on every driver
+void prepareForSave(u32 program);
+
+// Saves the linked program, and evicts the oldest entries
+void save(ProgramKey key, u32 program);
+
+}
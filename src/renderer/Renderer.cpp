@@ -1,10 +1,12 @@
 #include "Renderer.hpp"
+#include "GLExtensions.hpp"
 #include "Geode/cocos/CCDirector.h"
 #include "Geode/cocos/kazmath/include/kazmath/mat4.h"
 #include "Geode/cocos/platform/win32/CCGL.h"
 #include "GroupManager.hpp"
 #include "ObjectBatchNode.hpp"
 #include "SpriteMeshDictionary.hpp"
+#include "UniformSpriteDictionary.hpp"
 #include "ccTypes.h"
 #include "common.hpp"
 #include "glm/common.hpp"
@@ -12,13 +14,20 @@
 #include "math/ConvexPolygon.hpp"
 #include "math/Line.hpp"
 #include <Geode/Enums.hpp>
+#include <Geode/binding/ColorAction.hpp>
+#include <Geode/binding/ColorActionSprite.hpp>
+#include <Geode/binding/EffectGameObject.hpp>
 #include <Geode/binding/GJBaseGameLayer.hpp>
+#include <Geode/binding/GJEffectManager.hpp>
 #include <Geode/binding/RingObject.hpp>
 
 using namespace geode::prelude;
 
 static Renderer* currentRenderer;
 
+// Queried once, see DRB_UNIFORM_BUFFER_SIZE in shared.h
+static u32 drbUniformBufferSize = 0;
+
 Renderer::~Renderer() { terminate(); }
 
 static std::string byteSizeToString(usize size) {
@@ -31,6 +40,8 @@ static std::string byteSizeToString(usize size) {
 
 bool Renderer::init(PlayLayer* layer) {
     this->layer = layer;
+
+    registerMetrics();
     
     auto size = CCDirector::get()->getWinSize();
 
@@ -39,9 +50,39 @@ bool Renderer::init(PlayLayer* layer) {
 
     ingameEnableDisable = Mod::get()->getSettingValue<bool>("ingame_enable");
     useIndexCulling     = Mod::get()->getSettingValue<bool>("index_culling");
+    useGPUCulling       = Mod::get()->getSettingValue<bool>("gpu_culling");
+    useObjectResolvePass = Mod::get()->getSettingValue<bool>("object_resolve_pass");
+    useVertexPulling    = Mod::get()->getSettingValue<bool>("vertex_pulling");
+    useDrbUniformBuffer = Mod::get()->getSettingValue<bool>("drb_uniform_buffer");
+    useDepthPass        = Mod::get()->getSettingValue<bool>("depth_pass");
+    useOcclusionTrimming = Mod::get()->getSettingValue<bool>("occlusion_trimming");
+    useSpriteMerging    = Mod::get()->getSettingValue<bool>("sprite_merging");
+    useShaderSprites    = Mod::get()->getSettingValue<bool>("shader_sprites");
 
     log::info("OpenGL Version: {}", (const char*)glGetString(GL_VERSION));
 
+    glext::load();
+
+    // The object shaders are cached across levels, so this has to stay the same
+    if (useDrbUniformBuffer && drbUniformBufferSize == 0) {
+        i32 maxUniformBlockSize = 0;
+        glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxUniformBlockSize);
+        drbUniformBufferSize = std::clamp<u32>(maxUniformBlockSize, DRB_MIN_UNIFORM_BUFFER_SIZE, DRB_MAX_UNIFORM_BUFFER_SIZE) & ~15u;
+        log::info("Max uniform block size: {}, DRB uniform buffer size: {}", maxUniformBlockSize, drbUniformBufferSize);
+    }
+
+    // Runs on a worker thread while the objects are sorted
+    preprocessObjectShader(0);
+
+    i32 depthBits = 0;
+    if (useDepthPass) {
+        glGetIntegerv(GL_DEPTH_BITS, &depthBits);
+        if (depthBits < 24) {
+            log::warn("Depth buffer has {} bit(s), which is not enough for the depth pass", depthBits);
+            useDepthPass = false;
+        }
+    }
+
     auto tcache = cocos2d::CCTextureCache::get();
     // TODO: Add text sheet
     spriteSheets[(i32)SpriteSheet::GAME_1]   = tcache->addImage("GJ_GameSheet.png", false);
@@ -52,6 +93,25 @@ bool Renderer::init(PlayLayer* layer) {
     spriteSheets[(i32)SpriteSheet::PIXEL]    = tcache->addImage("PixelSheet_01.png", false);
 
     SpriteMeshDictionary::loadFromFile("spriteMeshes.json");
+    if (useDepthPass || useOcclusionTrimming) {
+        SpriteMeshDictionary::loadOpaqueMeshes();
+        // Without them, the opaque pass would never draw anything and no sprite could occlude another
+        if (SpriteMeshDictionary::getOpaqueMeshCount() == 0) {
+            log::warn("The mod was built without opaque sprite meshes, disabling the depth pass and occlusion trimming. Build with BISMUTH_GD_RESOURCES set to generate them");
+            useDepthPass         = false;
+            useOcclusionTrimming = false;
+        }
+    }
+
+    if (useSpriteMerging || useShaderSprites) {
+        for (auto texture : spriteSheets)
+            UniformSpriteDictionary::scanSpriteSheet(texture);
+    }
+
+    groupManager.findTargetedGroups(layer->m_objects);
+
+    if (useOcclusionTrimming)
+        findStaticOpaqueColorChannels();
 
     ObjectSorter sorter;
 
@@ -96,27 +156,64 @@ bool Renderer::init(PlayLayer* layer) {
 
     u32 groupCombCount = groupManager.getGroupCombinationCount();
     log::info("{} group combinations detected", groupCombCount);
+    log::info("{} of {} object(s) are baked", bakedObjectCount, renderedGameObjectCount);
+
+    // Both have to be known before the batches pick their object shader variants
+    usize packedGroupStateSize = groupManager.getPackedGroupStateSize() * sizeof(u32);
+    if (useDrbUniformBuffer && packedGroupStateSize > drbUniformBufferSize) {
+        log::info("Group states take {}, binding the DRB as a storage buffer", byteSizeToString(packedGroupStateSize));
+        useDrbUniformBuffer = false;
+    }
+
+    if (useObjectResolvePass && !prepareObjectResolvePass()) {
+        log::warn("The object resolve pass is not available, objects are resolved per vertex");
+        useObjectResolvePass = false;
+    }
 
     log::info("Generating vertex buffer...");
     generateBatchNodes(sorter);
 
-    log::info("Compiling shaders...");
+    if (useOcclusionTrimming)
+        log::info("{} sprite(s) are trimmed and {} sprite(s) are fully occluded", trimmedSpriteCount, removedSpriteCount);
+    if (useSpriteMerging)
+        log::info("{} sprite(s) are merged into {} quad(s)", mergedSpriteCount, mergedQuadCount);
+    if (useShaderSprites)
+        log::info("{} of {} sprite(s) are shader sprites", shaderSpriteCount, writtenSpriteCount);
+
+    log::info("Color table: {} entries ({} with HSV)", colorTable.getEntryCount(), colorTable.getHSVEntryCount());
+    if (!colorTable.prepare())
+        return false;
+
+    if (useGPUCulling && !prepareGPUCulling()) {
+        log::warn("GPU culling is not available, falling back to index culling");
+        useGPUCulling   = false;
+        useIndexCulling = true;
+    }
+
+    /*
+        Every vertex (or sprite with vertex pulling) needs its own depth
+        value. With GL_LESS, sprites that share one would disappear.
+        The opaque meshes of the batches are then never drawn.
+    */
+    if (useDepthPass && depthBits < 32 && (1ull << depthBits) <= depthOrderCount + 2) {
+        log::warn("Depth buffer is too small for {} draw order steps, disabling the depth pass", depthOrderCount);
+        useDepthPass = false;
+    }
 
-    std::map<std::string, std::string> shaderMacroVariables;
+    log::info("Compiling shaders...");
 
-    usize drbBufferSize = sizeof(DynamicRenderingBuffer) + sizeof(GroupCombinationState) * groupCombCount;
+    channelColors.resize(COLOR_CHANNEL_COUNT);
+    channelBlending.resize(COLOR_CHANNEL_COUNT);
 
-    i32 maxUniformBufferSize;
-    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxUniformBufferSize);
-    isDrbStorageBuffer = true;//drbBufferSize > maxUniformBufferSize;
+    groupCombinationStates.resize(groupCombCount);
+    groupManager.resetGroupStates();
+    // Rounded up to whole uvec4s
+    packedGroupStates.resize(std::max<usize>((groupManager.getPackedGroupStateSize() + 3) & ~3u, 4));
 
-    shaderMacroVariables["TOTAL_OBJECT_COUNT"] = std::to_string(renderedGameObjectCount == 0 ? 1 : renderedGameObjectCount);
-    shaderMacroVariables["GROUP_ID_LIMIT"]     = std::to_string(groupCombCount);
-    if (isDrbStorageBuffer)
-        shaderMacroVariables["IS_DRB_STORAGE_BUFFER"] = "";
+    // A uniform buffer has to be as large as the block in the shader
+    usize drbBufferSize = useDrbUniformBuffer ? drbUniformBufferSize : packedGroupStates.size() * sizeof(u32);
 
-    shader = Shader::create("object.vert", "object.frag", shaderMacroVariables);
-    if (!shader)
+    if (!compileObjectShaders())
         return false;
 
     drbBuffer = Buffer::createDynamicDraw(drbBufferSize);
@@ -127,8 +224,6 @@ bool Renderer::init(PlayLayer* layer) {
     if (!uniformBuffer)
         return false;
 
-    drb = (DynamicRenderingBuffer*)malloc(drbBuffer->getSize());
-
     debugText = CCLabelBMFont::create("", "chatFont.fnt");
     debugTextOutline1 = CCLabelBMFont::create("", "chatFont.fnt");
     debugTextOutline2 = CCLabelBMFont::create("", "chatFont.fnt");
@@ -156,6 +251,12 @@ bool Renderer::init(PlayLayer* layer) {
     setZOrder(-2);
     setEnabled(true);
 
+    metrics.set(vertexBufferSizeMetric, vertexBufferSize);
+    metrics.set(srbSizeMetric, srbBuffer->getSize());
+    metrics.set(drbSizeMetric, drbBuffer->getSize());
+    metrics.set(colorTableEntriesMetric, colorTable.getEntryCount());
+    metrics.openSink(Metrics::getSinkFormatSetting());
+
     rendererStartTime = getTime();
 
     reset();
@@ -164,13 +265,25 @@ bool Renderer::init(PlayLayer* layer) {
     return true;
 }
 
-void Renderer::generateBatchNodes(ObjectSorter& sorter) {
-    // objectBatch.allocateReservations();
-    // std::vector<GameObject*> objests;
-    // for (auto it = sorter.iterator(); !it.isEnd(); it.next())
-    //     objectBatch.writeGameObject(it.get());
-    // objectBatch.finishWriting();
+void Renderer::registerMetrics() {
+    frameTimeMetric         = metrics.addHistogram("frame_time_ns");
+    gjbglUpdateTimeMetric   = metrics.addHistogram("gjbgl_update_time_ns");
+    drawTimeMetric          = metrics.addHistogram("renderer_draw_time_ns");
+    batchNodeDrawTimeMetric = metrics.addHistogram("batch_node_draw_time_ns");
+    drbGenerationTimeMetric = metrics.addHistogram("drb_generation_time_ns");
+    gpuTimeMetric           = metrics.addHistogram("gpu_time_ns");
+
+    spritesOnScreenMetric = metrics.addCounter("sprites_on_screen");
+    batchNodeDrawsMetric  = metrics.addCounter("batch_node_draws");
+
+    vertexBufferSizeMetric     = metrics.addGauge("vertex_buffer_bytes");
+    srbSizeMetric              = metrics.addGauge("srb_bytes");
+    drbSizeMetric              = metrics.addGauge("drb_bytes");
+    objectShaderVariantsMetric = metrics.addGauge("object_shader_variants");
+    colorTableEntriesMetric    = metrics.addGauge("color_table_entries");
+}
 
+void Renderer::generateBatchNodes(ObjectSorter& sorter) {
     ZLayer      prevZLayer;
     SpriteSheet prevSpriteSheet;
 
@@ -191,17 +304,228 @@ void Renderer::generateBatchNodes(ObjectSorter& sorter) {
         }
 
         if (currentBatchNode)
-            currentBatchNode->addGameObject(it.get());
+            currentBatchNode->addGameObject(it.get(), it.getLayerIndex());
     }
 
-    for (auto node : batchNodes)
+    vertexBufferSize = 0;
+    chunkCount = 0;
+    depthOrderCount = 0;
+    trimmedSpriteCount = 0;
+    removedSpriteCount = 0;
+    mergedSpriteCount = 0;
+    mergedQuadCount = 0;
+    writtenSpriteCount = 0;
+    shaderSpriteCount = 0;
+    for (auto node : batchNodes) {
+        auto& batch = node->getBatch();
         node->generateBatch();
+        preprocessObjectShaders(batch);
+        vertexBufferSize   += batch.getVertexBufferSize();
+        chunkCount         += batch.getChunkCount();
+        trimmedSpriteCount += batch.getTrimmedSpriteCount();
+        removedSpriteCount += batch.getRemovedSpriteCount();
+        mergedSpriteCount  += batch.getMergedSpriteCount();
+        mergedQuadCount    += batch.getMergedQuadCount();
+        writtenSpriteCount += batch.getWrittenSpriteCount();
+        shaderSpriteCount  += batch.getShaderSpriteCount();
+
+        // The batch nodes are drawn in this order
+        batch.setDepthOrderOffset(depthOrderCount);
+        depthOrderCount += batch.getDepthOrderCount();
+    }
 }
 
-void Renderer::terminate() {
-    if (shader)
+/*
+    A color channel is dynamic when a trigger targets it or it copies
+    another channel. The player colors and LBG are always blending.
+*/
+void Renderer::findStaticOpaqueColorChannels() {
+    staticOpaqueColorChannels.assign(COLOR_CHANNEL_COUNT, false);
+
+    std::unordered_set<i32> targetedColorChannels;
+    for (auto object : CCArrayExt<GameObject*>(layer->m_objects)) {
+        auto effectObject = typeinfo_cast<EffectGameObject*>(object);
+        if (effectObject && effectObject->m_targetColor > 0)
+            targetedColorChannels.insert(effectObject->m_targetColor);
+    }
+
+    auto effectManager = layer->m_effectManager;
+
+    for (auto sprite : effectManager->m_colorActionSpriteVector) {
+        if (sprite == nullptr)
+            continue;
+
+        auto id = sprite->m_colorID;
+        if (id < 0 || id >= COLOR_CHANNEL_COUNT)
+            continue;
+
+        if (id == COLOR_CHANNEL_P1 || id == COLOR_CHANNEL_P2 || id == COLOR_CHANNEL_LBG)
+            continue;
+
+        if (targetedColorChannels.contains(id))
+            continue;
+
+        auto action = effectManager->getColorAction(id);
+        if (action && action->m_copyID != 0)
+            continue;
+
+        staticOpaqueColorChannels[id] = sprite->m_opacity >= 255.0f && !layer->shouldBlend(id);
+    }
+
+    staticOpaqueColorChannels[COLOR_CHANNEL_BLACK] = true;
+}
+
+static const std::pair<u32, const char*> objectShaderVariantMacros[] = {
+    { OBJECT_SHADER_BAKED,                   "BAKED_OBJECTS"           },
+    { OBJECT_SHADER_OPAQUE_PASS,             "OPAQUE_PASS"             },
+    { OBJECT_SHADER_RESOLVED_OBJECTS,        "RESOLVED_OBJECTS"        },
+    { OBJECT_SHADER_VERTEX_PULLING,          "VERTEX_PULLING"          },
+    { OBJECT_SHADER_DRB_UNIFORM_BUFFER,      "DRB_UNIFORM_BUFFER"      },
+    { OBJECT_SHADER_FEATURE_HSV,             "FEATURE_HSV"             },
+    { OBJECT_SHADER_FEATURE_AUDIO_SCALE,     "FEATURE_AUDIO_SCALE"     },
+    { OBJECT_SHADER_FEATURE_INVISIBLE_BLOCK, "FEATURE_INVISIBLE_BLOCK" },
+    { OBJECT_SHADER_FEATURE_ROTATION,        "FEATURE_ROTATION"        },
+    { OBJECT_SHADER_FEATURE_LOCAL_TRANSFORM, "FEATURE_LOCAL_TRANSFORM" },
+    { OBJECT_SHADER_FEATURE_SPECIAL_GLOW,    "FEATURE_SPECIAL_GLOW"    },
+};
+
+static std::map<std::string, std::string> getObjectShaderMacroVariables(u32 variant) {
+    std::map<std::string, std::string> macroVariables;
+    for (auto [flag, macro] : objectShaderVariantMacros) {
+        if (variant & flag)
+            macroVariables[macro] = "";
+    }
+    if (variant & OBJECT_SHADER_DRB_UNIFORM_BUFFER)
+        macroVariables["DRB_UNIFORM_BUFFER_SIZE"] = std::to_string(drbUniformBufferSize);
+    return macroVariables;
+}
+
+// The compute shaders only need to know how the DRB is declared
+static std::map<std::string, std::string> getDrbMacroVariables(bool uniformBuffer) {
+    if (uniformBuffer) {
+        return {
+            { "DRB_UNIFORM_BUFFER",      "" },
+            { "DRB_UNIFORM_BUFFER_SIZE", std::to_string(drbUniformBufferSize) }
+        };
+    }
+    return {};
+}
+
+// Sets the uniforms that never change
+static void setupObjectShader(Shader* shader) {
+    // The batch nodes bind their sprite sheet to texture unit 0
+    shader->setInt("u_spriteSheet", 0);
+}
+
+/*
+    Waits for the driver if the variant is still compiling, and
+    sets it up the first time. Destroys the variant if it failed.
+*/
+static bool finishObjectShader(u32 variant, Shader*& shader) {
+    if (shader->isFinished())
+        return true;
+
+    if (!shader->finish()) {
+        log::error("Failed to compile object shader variant {:#x}", variant);
         Shader::destroy(shader);
-    shader = nullptr;
+        shader = nullptr;
+        return false;
+    }
+
+    setupObjectShader(shader);
+    return true;
+}
+
+Shader* Renderer::getObjectShader(u32 variant) {
+    auto it = objectShaders.find(variant);
+    if (it != objectShaders.end()) {
+        if (it->second)
+            finishObjectShader(variant, it->second);
+        return it->second;
+    }
+
+    Shader* shader = Shader::create("object.vert", "object.frag", getObjectShaderMacroVariables(variant));
+    if (shader)
+        setupObjectShader(shader);
+    else
+        log::error("Failed to compile object shader variant {:#x}", variant);
+
+    objectShaders[variant] = shader;
+    return shader;
+}
+
+// Does nothing if the variant is already compiled or being preprocessed
+void Renderer::preprocessObjectShader(u32 variant) {
+    if (objectShaders.contains(variant) || preprocessingObjectShaders.contains(variant))
+        return;
+
+    preprocessingObjectShaders[variant] = Shader::preprocessAsync(
+        "object.vert", "object.frag", getObjectShaderMacroVariables(variant)
+    );
+}
+
+void Renderer::preprocessObjectShaders(ObjectBatch& batch) {
+    for (auto& drawList : batch.getDrawLists()) {
+        u32 variant = batch.getObjectShaderVariant(drawList);
+        preprocessObjectShader(variant);
+        if (useDepthPass)
+            preprocessObjectShader(variant | OBJECT_SHADER_OPAQUE_PASS);
+    }
+}
+
+/*
+    Starts compiling every variant that is drawn with. The
+    driver compiles them while the rest of the level loads,
+    and finishObjectShaders() waits for them.
+*/
+bool Renderer::compileObjectShaders() {
+    usize variantCount = preprocessingObjectShaders.size();
+
+    for (auto& [variant, sources] : preprocessingObjectShaders) {
+        auto result = sources.get();
+        if (!result) {
+            log::error("Failed to preprocess object shader variant {:#x}", variant);
+            preprocessingObjectShaders.clear();
+            return false;
+        }
+
+        objectShaders[variant] = Shader::createAsync(result.value());
+        compilingObjectShaders.push_back(variant);
+    }
+    preprocessingObjectShaders.clear();
+
+    log::info("Compiling {} object shader variant(s) for this level", variantCount);
+    return true;
+}
+
+/*
+    Finishes the variants started by compileObjectShaders(). Without
+    wait, only the variants the driver is done with are finished.
+    Returns false if any of them failed to compile.
+*/
+bool Renderer::finishObjectShaders(bool wait) {
+    bool success = true;
+
+    std::erase_if(compilingObjectShaders, [&](u32 variant) {
+        auto& shader = objectShaders[variant];
+        if (!shader)
+            return true;
+        if (!wait && !shader->isReady())
+            return false;
+
+        if (!finishObjectShader(variant, shader))
+            success = false;
+        return true;
+    });
+
+    return success;
+}
+
+void Renderer::terminate() {
+    // The object shaders are kept for the next level, but the failed variants are tried again
+    std::erase_if(objectShaders, [](const auto& entry) { return entry.second == nullptr; });
+
+    metrics.closeSink();
 
     if (basicShader)
         Shader::destroy(basicShader);
@@ -209,8 +533,6 @@ void Renderer::terminate() {
 
     if (drbBuffer)
         Buffer::destroy(drbBuffer);
-    if (drb)
-        free(drb);
 
     if (srbBuffer)
         Buffer::destroy(srbBuffer);
@@ -218,6 +540,24 @@ void Renderer::terminate() {
     if (uniformBuffer)
         Buffer::destroy(uniformBuffer);
 
+    if (objectResolveShader)
+        Shader::destroy(objectResolveShader);
+    objectResolveShader = nullptr;
+
+    if (resolvedObjectBuffer)
+        Buffer::destroy(resolvedObjectBuffer);
+
+    if (chunkCullingShader)
+        Shader::destroy(chunkCullingShader);
+    chunkCullingShader = nullptr;
+
+    if (chunkBuffer)
+        Buffer::destroy(chunkBuffer);
+    if (drawCommandBuffer)
+        Buffer::destroy(drawCommandBuffer);
+    if (drawCountBuffer)
+        Buffer::destroy(drawCountBuffer);
+
     currentRenderer = nullptr;
     log::info("Renderer terminated");
 }
@@ -232,12 +572,26 @@ void Renderer::prepareShaderUniforms() {
 	
 	kmMat4Multiply(&matrixMVP, &matrixP, &matrixMV);
 
-    shader->setTextureArray("u_spriteSheets", (i32)SpriteSheet::COUNT, spriteSheets);
+    for (auto [variant, objectShader] : objectShaders) {
+        if (objectShader)
+            objectShader->setTextureArray("u_spriteSheets", (i32)SpriteSheet::COUNT, spriteSheets);
+    }
 
     (kmMat4&)uniforms.u_mvp = matrixMVP;
     uniforms.u_timer = gameTimer;
+    uniforms.u_depthScale = 1.0 / (double)(depthOrderCount + 2);
     uniforms.u_cameraPosition = ccPointToGLM(layer->m_gameState.m_cameraPosition2);
     uniforms.u_cameraViewSize = glm::vec2(layer->m_cameraWidth, layer->m_cameraHeight);
+
+    /*
+        The camera can be rotated, so the view bounds are the
+        bounds of the circle going through the view corners.
+    */
+    glm::vec2 cameraCenter = uniforms.u_cameraPosition + uniforms.u_cameraViewSize * 0.5f;
+    float     cameraRadius = glm::length(uniforms.u_cameraViewSize * 0.5f) + CHUNK_CULLING_MARGIN;
+    cameraViewMin = cameraCenter - cameraRadius;
+    cameraViewMax = cameraCenter + cameraRadius;
+
     auto winsize = CCDirector::get()->getWinSize();
     uniforms.u_winSize = glm::vec2(winsize.width, winsize.height);
     uniforms.u_screenRight = CCDirector::get()->getScreenRight();
@@ -245,6 +599,13 @@ void Renderer::prepareShaderUniforms() {
     ccColor3B specialLightBG = GameToolbox::transformColor(layer->m_effectManager->activeColorForIndex(COLOR_CHANNEL_BG), 0.0, -0.2, 0.2);
     uniforms.u_specialLightBGColor = ccColor3BToGLM(specialLightBG);
 
+    // Invisible block glow fades to white on bright backgrounds and to LBG otherwise
+    ccColor3B colorBG = layer->m_effectManager->activeColorForIndex(COLOR_CHANNEL_BG);
+    if (colorBG.r + colorBG.g + colorBG.b >= 150)
+        uniforms.u_invisibleBlockGlowColor = glm::vec3(1, 1, 1);
+    else
+        uniforms.u_invisibleBlockGlowColor = ccColor3BToGLM(layer->m_effectManager->activeColorForIndex(COLOR_CHANNEL_LBG));
+
     uniforms.u_gameStateFlags = 0;
     if (layer->m_player1->m_isDead)
         uniforms.u_gameStateFlags |= GAME_STATE_IS_PLAYER_DEAD;
@@ -272,10 +633,10 @@ void Renderer::prepareDynamicRenderingBuffer() {
 
         auto id = sprite->m_colorID;
 
-        drb->channelColors[id].r = sprite->m_color.r;
-        drb->channelColors[id].g = sprite->m_color.g;
-        drb->channelColors[id].b = sprite->m_color.b;
-        drb->channelColors[id].a = (u8)sprite->m_opacity;
+        channelColors[id].r = sprite->m_color.r;
+        channelColors[id].g = sprite->m_color.g;
+        channelColors[id].b = sprite->m_color.b;
+        channelColors[id].a = (u8)sprite->m_opacity;
 
         bool shouldBlend = layer->shouldBlend(id);
         if (
@@ -286,37 +647,60 @@ void Renderer::prepareDynamicRenderingBuffer() {
             shouldBlend = true;
         }
 
-        if (shouldBlend)
-            drb->colorChannelBlendingBitmap[id >> 5] |= 1 << (id & 0x1f);
-        else
-            drb->colorChannelBlendingBitmap[id >> 5] &= ~(1 << (id & 0x1f));
+        channelBlending[id] = shouldBlend;
     }
 
-    drb->channelColors[COLOR_CHANNEL_BLACK] = { 0, 0, 0, 255 };
+    channelColors[COLOR_CHANNEL_BLACK] = { 0, 0, 0, 255 };
+
+    colorTable.update(channelColors, channelBlending);
+    colorTable.bind();
 
     groupManager.updateOpacities();
+    groupManager.packGroupStates(packedGroupStates);
 
-    drbBuffer->write(drb, drbBuffer->getSize());
-    if (isDrbStorageBuffer)
-        drbBuffer->bindAsStorageBuffer(DYNAMIC_RENDERING_BUFFER_BINDING);
-    else
-        drbBuffer->bindAsUniformBuffer(DYNAMIC_RENDERING_BUFFER_BINDING);
+    drbBuffer->write(packedGroupStates.data(), packedGroupStates.size() * sizeof(u32));
+    bindDynamicRenderingBuffer();
 
-    drbGenerationTime = getTime() - prevTime;
+    metrics.record(drbGenerationTimeMetric, getTime() - prevTime);
 }
 
-static u32 convertToShaderHSV(const ccHSVValue& hsv) {
-    u32 hue = hsv.h + 256.f;
-    u32 sat = ( hsv.s + (hsv.absoluteSaturation ? 1.0 : 0.0) ) * 127.5f;
-    u32 val = ( hsv.v + (hsv.absoluteBrightness ? 1.0 : 0.0) ) * 127.5f;
-
-    u32 ret = (hue & HSV_HUE_MASK) << HSV_HUE_BIT |
-              (sat & HSV_SAT_MASK) << HSV_SAT_BIT |
-              (val & HSV_VAL_MASK) << HSV_VAL_BIT;
+void Renderer::bindDynamicRenderingBuffer() {
+    if (useDrbUniformBuffer)
+        drbBuffer->bindAsUniformBuffer(DYNAMIC_RENDERING_BUFFER_BINDING);
+    else
+        drbBuffer->bindAsStorageBuffer(DYNAMIC_RENDERING_BUFFER_BINDING);
+}
 
-    if (hsv.absoluteSaturation) ret |= HSV_SAT_ADD;
-    if (hsv.absoluteBrightness) ret |= HSV_VAL_ADD;
-    return ret;
+// The baked shader doesn't read the SRB, so objects with these flags can't be baked
+static constexpr i32 unbakeableObjectFlags =
+    OBJECT_FLAG_USES_AUDIO_SCALE   |
+    OBJECT_FLAG_IS_INVISIBLE_BLOCK |
+    OBJECT_FLAG_SPECIAL_GLOW_COLOR |
+    OBJECT_FLAG_HAS_BASE_HSV       |
+    OBJECT_FLAG_HAS_DETAIL_HSV;
+
+u32 Renderer::getShaderFeaturesOfObject(const StaticObjectInfo& objectInfo, GroupCombinationIndex groupCombIndex) {
+    u32 features = 0;
+
+    // The HSV of other objects is resolved by the color table
+    bool hasHSV = objectInfo.flags & (OBJECT_FLAG_HAS_BASE_HSV | OBJECT_FLAG_HAS_DETAIL_HSV);
+    if (hasHSV && (objectInfo.flags & (OBJECT_FLAG_IS_INVISIBLE_BLOCK | OBJECT_FLAG_SPECIAL_GLOW_COLOR)))
+        features |= OBJECT_SHADER_FEATURE_HSV;
+    if (objectInfo.flags & OBJECT_FLAG_USES_AUDIO_SCALE)
+        features |= OBJECT_SHADER_FEATURE_AUDIO_SCALE;
+    if (objectInfo.flags & OBJECT_FLAG_IS_INVISIBLE_BLOCK)
+        features |= OBJECT_SHADER_FEATURE_INVISIBLE_BLOCK;
+    if (objectInfo.flags & OBJECT_FLAG_SPECIAL_GLOW_COLOR)
+        features |= OBJECT_SHADER_FEATURE_SPECIAL_GLOW;
+    if (objectInfo.rotationSpeed != 0.0)
+        features |= OBJECT_SHADER_FEATURE_ROTATION;
+
+    // The local transform of a static group combination never changes
+    bool isStaticGroupCombination = groupManager.isGroupCombinationStatic(groupCombIndex);
+    if ((objectInfo.flags & OBJECT_FLAG_IS_STATIC_OBJECT) == 0 && !isStaticGroupCombination)
+        features |= OBJECT_SHADER_FEATURE_LOCAL_TRANSFORM;
+
+    return features;
 }
 
 void Renderer::generateStaticRenderingBuffer(ObjectSorter& sorter) {
@@ -351,17 +735,18 @@ void Renderer::generateStaticRenderingBuffer(ObjectSorter& sorter) {
 
         if (object->m_baseColor && object->m_baseColor->m_usesHSV) {
             objectInfo->flags |= OBJECT_FLAG_HAS_BASE_HSV;
-            objectInfo->baseHSV = convertToShaderHSV(object->m_baseColor->m_hsv);
+            objectInfo->baseHSV = ColorTable::convertToShaderHSV(object->m_baseColor->m_hsv);
         }
 
         if (object->m_detailColor && object->m_detailColor->m_usesHSV) {
             objectInfo->flags |= OBJECT_FLAG_HAS_DETAIL_HSV;
-            objectInfo->detailHSV = convertToShaderHSV(object->m_detailColor->m_hsv);
+            objectInfo->detailHSV = ColorTable::convertToShaderHSV(object->m_detailColor->m_hsv);
         }
 
         objectInfo->opacity = (object->m_opacityMod2 > 0.0) ? object->m_opacityMod2 : 1.0;
 
-        objectInfo->groupCombinationIndex = groupManager.getGroupCombinationIndexForObject(object);
+        auto groupCombIndex = groupManager.getGroupCombinationIndexForObject(object);
+        objectInfo->groupStateLocation = groupManager.getGroupStateLocation(groupCombIndex);
 
         if (object->m_isInvisibleBlock) objectInfo->flags |= OBJECT_FLAG_IS_INVISIBLE_BLOCK;
         if (object->m_customGlowColor)  objectInfo->flags |= OBJECT_FLAG_SPECIAL_GLOW_COLOR;
@@ -369,15 +754,140 @@ void Renderer::generateStaticRenderingBuffer(ObjectSorter& sorter) {
             objectInfo->flags |= OBJECT_FLAG_IS_STATIC_OBJECT;
         objectInfo->fadeMargin = object->m_fadeMargin;
 
+        bool isBaked =
+            groupManager.isGroupCombinationStatic(groupCombIndex) &&
+            objectInfo->rotationSpeed == 0.0 &&
+            objectInfo->opacity == 1.0 &&
+            (objectInfo->flags & unbakeableObjectFlags) == 0;
+
+        if (isBaked)
+            bakedObjectCount++;
+
         objectSRBIndicies[object] = index;
-        groupCombIndexPerObjectSRBIndex.push_back(objectInfo->groupCombinationIndex);
-        startPositionPerObjectSRBIndex.push_back(objectInfo->startPosition);
+        groupCombIndexPerObjectSRBIndex.push_back(groupCombIndex);
+        bakedPerObjectSRBIndex.push_back(isBaked);
+        shaderFeaturesPerObjectSRBIndex.push_back(isBaked ? 0 : getShaderFeaturesOfObject(*objectInfo, groupCombIndex));
         index++;
     }
 
     srbBuffer = Buffer::createStaticDraw(objectInfos.data(), objectInfos.size() * sizeof(StaticObjectInfo));
 };
 
+/*
+    The resolve pass writes the state of every object once per
+    frame with the resolveObjects.comp compute shader, so the
+    object shader doesn't have to work it out for every vertex.
+*/
+bool Renderer::prepareObjectResolvePass() {
+    if (!glext::supportsComputeShaders() || renderedGameObjectCount == 0)
+        return false;
+
+    objectResolveShader = Shader::createCompute("resolveObjects.comp", getDrbMacroVariables(useDrbUniformBuffer));
+    if (!objectResolveShader)
+        return false;
+
+    resolvedObjectBuffer = Buffer::createDynamicCopy(renderedGameObjectCount * sizeof(ResolvedObject));
+
+    log::info("Object resolve pass enabled for {} object(s)", renderedGameObjectCount);
+    return true;
+}
+
+void Renderer::resolveObjectsOnGPU() {
+    srbBuffer->bindAsStorageBuffer(STATIC_RENDERING_BUFFER_BINDING);
+    bindDynamicRenderingBuffer();
+    uniformBuffer->bindAsUniformBuffer(RENDERER_UNIFORM_BUFFER_BINDING);
+    resolvedObjectBuffer->bindAsStorageBuffer(RESOLVED_OBJECT_BUFFER_BINDING);
+
+    objectResolveShader->use();
+    objectResolveShader->setUInt("u_objectCount", renderedGameObjectCount);
+
+    glext::dispatchCompute((renderedGameObjectCount + OBJECT_RESOLVE_GROUP_SIZE - 1) / OBJECT_RESOLVE_GROUP_SIZE, 1, 1);
+
+    // The resolved objects are read by the batch nodes drawn after this
+    glext::memoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+/*
+    Uploads the chunks of every batch so they can be culled by
+    the cullChunks.comp compute shader. Every draw list of every
+    batch gets its own range in the draw command buffer. The
+    commands and draw counts of the opaque pass come after all
+    of these.
+*/
+bool Renderer::prepareGPUCulling() {
+    if (!glext::supportsComputeShaders() || !glext::supportsIndirectDraws())
+        return false;
+
+    std::vector<ObjectChunkInfo> chunkInfos;
+
+    u32 drawListIndex = 0;
+    for (auto node : batchNodes) {
+        auto& batch = node->getBatch();
+        auto& chunks = batch.getChunks();
+
+        for (auto& drawList : batch.getDrawLists()) {
+            drawList.gpuDrawListIndex = drawListIndex;
+            drawList.gpuFirstCommand  = chunkInfos.size();
+
+            for (u32 i = 0; i < drawList.chunkCount; i++) {
+                auto& chunk = chunks[drawList.firstChunk + i];
+                chunkInfos.push_back({
+                    chunk.boundsMin,
+                    chunk.boundsMax,
+                    chunk.extent,
+                    groupManager.getGroupStateLocation(chunk.groupCombinationIndex),
+                    chunk.firstIndex,
+                    chunk.indexCount,
+                    chunk.firstOpaqueIndex,
+                    chunk.opaqueIndexCount,
+                    drawListIndex,
+                    i,
+                    drawList.chunkCount
+                });
+            }
+
+            drawListIndex++;
+        }
+    }
+
+    if (chunkInfos.empty())
+        return false;
+
+    chunkCullingShader = Shader::createCompute("cullChunks.comp", getDrbMacroVariables(useDrbUniformBuffer));
+    if (!chunkCullingShader)
+        return false;
+
+    gpuChunkCount    = chunkInfos.size();
+    gpuDrawListCount = drawListIndex;
+    drawCountClearData.resize(gpuDrawListCount * 2, 0);
+
+    chunkBuffer       = Buffer::createStaticDraw(chunkInfos.data(), chunkInfos.size() * sizeof(ObjectChunkInfo));
+    drawCommandBuffer = Buffer::createDynamicCopy(gpuChunkCount * 2 * sizeof(DrawElementsIndirectCommand));
+    drawCountBuffer   = Buffer::createDynamicDraw(drawCountClearData.size() * sizeof(u32));
+
+    log::info("GPU culling enabled for {} chunk(s)", gpuChunkCount);
+    return true;
+}
+
+void Renderer::cullChunksOnGPU() {
+    drawCountBuffer->write(drawCountClearData.data(), drawCountBuffer->getSize());
+
+    bindDynamicRenderingBuffer();
+    uniformBuffer->bindAsUniformBuffer(RENDERER_UNIFORM_BUFFER_BINDING);
+    chunkBuffer->bindAsStorageBuffer(OBJECT_CHUNK_BUFFER_BINDING);
+    drawCommandBuffer->bindAsStorageBuffer(DRAW_COMMAND_BUFFER_BINDING);
+    drawCountBuffer->bindAsStorageBuffer(DRAW_COUNT_BUFFER_BINDING);
+
+    chunkCullingShader->use();
+    chunkCullingShader->setUInt("u_chunkCount", gpuChunkCount);
+    chunkCullingShader->setUInt("u_drawListCount", gpuDrawListCount);
+
+    glext::dispatchCompute((gpuChunkCount + CHUNK_CULLING_GROUP_SIZE - 1) / CHUNK_CULLING_GROUP_SIZE, 1, 1);
+
+    // The draw commands are read by the batch nodes drawn after this
+    glext::memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
 static glm::vec2 linePoint = { 100, 200 };
 static float     lineAngle = 0;
 
@@ -400,11 +910,34 @@ static void drawCross(Renderer* ren, const glm::vec2& point, const glm::vec4& co
 }
 
 void Renderer::draw() {
+    if (!compilingObjectShaders.empty() && !finishObjectShaders(true)) {
+        log::error("Object shaders failed to compile, disabling the renderer");
+        setEnabled(false);
+        return;
+    }
+
+    u64 drawBeginTime = getTime();
+
     storeGLStates();
     prepareShaderUniforms();
+
+    gpuTimer.begin("DRB and compute passes");
     if (!isPaused())
         prepareDynamicRenderingBuffer();
 
+    if (useObjectResolvePass)
+        resolveObjectsOnGPU();
+
+    if (useGPUCulling)
+        cullChunksOnGPU();
+    gpuTimer.end();
+
+    if (useDepthPass) {
+        glDepthMask(GL_TRUE);
+        glClearDepth(1.0);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
     /*
     glm::vec2 normal { glm::cos(glm::radians(lineAngle)), glm::sin(glm::radians(lineAngle)) };
 
@@ -469,6 +1002,9 @@ void Renderer::draw() {
     drawFuncTime = getTime() - prevTime;
     */
 
+    metrics.set(objectShaderVariantsMetric, objectShaders.size());
+    metrics.record(drawTimeMetric, getTime() - drawBeginTime);
+
     if (debugText->isVisible())
         updateDebugText();
 }
@@ -480,7 +1016,7 @@ void Renderer::updateDebugText() {
 
     if (!enabled) {
         text += "Bismuth renderer is disabled\n";
-        text += fmt::format("Total frame time: {}ms\n", (double)totalFrameTime / 1000000.0);
+        text += fmt::format("Total frame time: {}ms\n", (double)metrics.getLastValue(frameTimeMetric) / 1000000.0);
         text += "Press F8 to enable\n";
     } else {
         if (debugTextEnabled) {
@@ -490,15 +1026,45 @@ void Renderer::updateDebugText() {
             text += fmt::format("OpenGL {}\n", (const char*)glGetString(GL_VERSION));
             text += fmt::format("{}\n", (const char*)glGetString(GL_RENDERER));
             text += fmt::format("Window: {}x{}\n", screenSize.width, screenSize.height);
-            text += fmt::format("Render time: {}ms\n", (double)renderTime / 1000000.0);
-            text += fmt::format("DRB generation time: {}ms\n", (double)drbGenerationTime / 1000000.0);
-            text += fmt::format("Renderer::draw() time: {}ms\n", (double)drawFuncTime / 1000000.0);
-            text += fmt::format("GJBaseGameLayer::update() time: {}ms\n", (double)gjbglUpdateTime / 1000000.0);
-            text += fmt::format("Total frame time: {}ms\n", (double)totalFrameTime / 1000000.0);
-            text += fmt::format("Vertex buffer size: {}\n", byteSizeToString(objectBatch.getQuadCount() * sizeof(ObjectQuad)));
-            text += fmt::format("Sprites on screen: {}\n", spritesOnScreen);
+            text += fmt::format("GPU time: {}ms\n", (double)gpuTimer.getTotalTime() / 1000000.0);
+            for (auto& result : gpuTimer.getResults())
+                text += fmt::format("- {}: {:.3f}ms\n", result.name, (double)result.time / 1000000.0);
+            text += fmt::format("DRB generation time: {}ms\n", (double)metrics.getLastValue(drbGenerationTimeMetric) / 1000000.0);
+            text += fmt::format("Renderer::draw() time: {}ms\n", (double)metrics.getLastValue(drawTimeMetric) / 1000000.0);
+            text += fmt::format("Batch node draw time: {}ms\n", (double)metrics.getLastValue(batchNodeDrawTimeMetric) / 1000000.0);
+            text += fmt::format("GJBaseGameLayer::update() time: {}ms\n", (double)metrics.getLastValue(gjbglUpdateTimeMetric) / 1000000.0);
+            text += fmt::format("Total frame time: {}ms\n", (double)metrics.getLastValue(frameTimeMetric) / 1000000.0);
+            text += fmt::format("Vertex buffer size: {}\n", byteSizeToString(vertexBufferSize));
+            text += fmt::format("Object chunks: {}\n", chunkCount);
+            text += fmt::format("Baked objects: {} / {}\n", bakedObjectCount, renderedGameObjectCount);
+            text += fmt::format("Depth pass: {}\n", useDepthPass ? "enabled" : "disabled");
+            text += fmt::format("Object resolve pass: {}\n", useObjectResolvePass ? "enabled" : "disabled");
+            text += fmt::format("Vertex pulling: {}\n", useVertexPulling ? "enabled" : "disabled");
+            text += fmt::format("Object shader variants: {}\n", objectShaders.size());
+            text += fmt::format("Color table: {} entries ({} with HSV)\n", colorTable.getEntryCount(), colorTable.getHSVEntryCount());
+            if (useOcclusionTrimming)
+                text += fmt::format("Trimmed sprites: {} (removed: {})\n", trimmedSpriteCount, removedSpriteCount);
+            if (useSpriteMerging)
+                text += fmt::format("Merged sprites: {} into {} quads\n", mergedSpriteCount, mergedQuadCount);
+            if (useShaderSprites) {
+                double hitRate = writtenSpriteCount == 0 ? 0.0 : (double)shaderSpriteCount / writtenSpriteCount * 100.0;
+                text += fmt::format("Shader sprites: {} / {} ({:.1f}%)\n", shaderSpriteCount, writtenSpriteCount, hitRate);
+            }
+            if (useGPUCulling) {
+                text += "Culling: GPU\n";
+                text += fmt::format("Sprites submitted: {} (at most)\n", metrics.getLastValue(spritesOnScreenMetric));
+            } else {
+                text += fmt::format("Culling: {}\n", useIndexCulling ? "CPU" : "disabled");
+                text += fmt::format("Sprites on screen: {}\n", metrics.getLastValue(spritesOnScreenMetric));
+            }
             text += fmt::format("Static rendering buffer size: {}\n", byteSizeToString(srbBuffer->getSize()));
-            text += fmt::format("Dynamic rendering buffer size: {}\n", byteSizeToString(drbBuffer->getSize()));
+            text += fmt::format(
+                "Dynamic rendering buffer size: {} ({})\n",
+                byteSizeToString(drbBuffer->getSize()),
+                useDrbUniformBuffer ? "uniform buffer" : "storage buffer"
+            );
+            if (metrics.isSinkOpen())
+                text += "Streaming metrics to the save directory\n";
             text += "\n";
             text += "Press F3 to hide this screen";
         } else if (differenceModeEnabled)
@@ -513,11 +1079,21 @@ void Renderer::updateDebugText() {
 Shader* Renderer::prepareDraw() {
     storeGLStates();
 
-    shader->use();
+    auto shader = useObjectShader(0);
 
     srbBuffer->bindAsStorageBuffer(STATIC_RENDERING_BUFFER_BINDING);
-    drbBuffer->bindAsStorageBuffer(DYNAMIC_RENDERING_BUFFER_BINDING);
+    bindDynamicRenderingBuffer();
     uniformBuffer->bindAsUniformBuffer(RENDERER_UNIFORM_BUFFER_BINDING);
+    colorTable.bind();
+
+    if (useObjectResolvePass)
+        resolvedObjectBuffer->bindAsStorageBuffer(RESOLVED_OBJECT_BUFFER_BINDING);
+
+    if (useGPUCulling) {
+        drawCommandBuffer->bindAs(GL_DRAW_INDIRECT_BUFFER);
+        if (glext::multiDrawElementsIndirectCount)
+            drawCountBuffer->bindAs(GL_PARAMETER_BUFFER_ARB);
+    }
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
@@ -525,12 +1101,34 @@ Shader* Renderer::prepareDraw() {
     return shader;
 }
 
+/*
+    The opaque pass draws the fully opaque fragments front
+    to back while writing depth. The translucent pass then
+    draws everything back to front with only the depth test,
+    so nothing behind (or equal to) an opaque fragment is
+    drawn twice.
+*/
+void Renderer::beginOpaquePass() {
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
+
+void Renderer::beginTranslucentPass() {
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+}
+
 void Renderer::finishDraw() {
     restoreGLStates();
 }
 
 void Renderer::update(float dt) {
     gameTimer += dt;
+
+    if (!compilingObjectShaders.empty() && !finishObjectShaders(false))
+        setEnabled(false);
     
     float audioScale;
     if (layer->m_skipAudioStep)
@@ -543,18 +1141,37 @@ void Renderer::update(float dt) {
 
     if (debugText->isVisible())
         updateDebugText();
-
-    auto& gstate = layer->m_gameState;
-    cameraCenterPos = ccPointToGLM(gstate.m_cameraPosition2 + CCPoint(layer->m_cameraWidth * 0.5, layer->m_cameraHeight * 0.5));
 }
 
-bool Renderer::isObjectInView(usize srbIndex) {
-    GroupCombinationIndex groupCombIndex = groupCombIndexPerObjectSRBIndex[srbIndex];
+bool Renderer::isChunkInView(const ObjectBatchChunk& chunk) {
+    auto& state = groupCombinationStates[chunk.groupCombinationIndex];
+
+    // Transform all four corners as the positional transform can rotate the bounds
+    glm::vec2 corners[4] = {
+        { chunk.boundsMin.x, chunk.boundsMin.y },
+        { chunk.boundsMax.x, chunk.boundsMin.y },
+        { chunk.boundsMin.x, chunk.boundsMax.y },
+        { chunk.boundsMax.x, chunk.boundsMax.y }
+    };
+
+    glm::vec2 boundsMin = state.positionalTransform * corners[0] + state.offset;
+    glm::vec2 boundsMax = boundsMin;
+    for (i32 i = 1; i < 4; i++) {
+        glm::vec2 corner = state.positionalTransform * corners[i] + state.offset;
+        boundsMin = glm::min(boundsMin, corner);
+        boundsMax = glm::max(boundsMax, corner);
+    }
 
-    auto& state = drb->groupCombinationStates[groupCombIndex];
-    glm::vec2 diff = glm::abs((state.positionalTransform * startPositionPerObjectSRBIndex[srbIndex] + state.offset) - cameraCenterPos);
+    // The sprites around the object positions are scaled by the local transform
+    float extent = chunk.extent * std::max(
+        glm::length(state.localTransform[0]),
+        glm::length(state.localTransform[1])
+    );
+    boundsMin -= extent;
+    boundsMax += extent;
 
-    return (diff.x * diff.x + diff.y * diff.y) <= (350 * 350);
+    return boundsMax.x >= cameraViewMin.x && boundsMin.x <= cameraViewMax.x &&
+           boundsMax.y >= cameraViewMin.y && boundsMin.y <= cameraViewMax.y;
 }
 
 Ref<Renderer> Renderer::create(PlayLayer* layer) {
@@ -683,6 +1300,8 @@ class $modify(RendererCCKeyboardDispatcher, CCKeyboardDispatcher) {
 static i32 storedVAO, storedVBO, storedIBO, storedProgram;
 static i32 storedBlendSrcAlpha, storedBlendSrcRGB;
 static i32 storedBlendDstAlpha, storedBlendDstRGB;
+static i32 storedDepthFunc;
+static u8  storedDepthTest, storedDepthMask, storedBlend;
 
 static i32 storedTextures[9];
 
@@ -698,6 +1317,11 @@ void storeGLStates() {
     glGetIntegerv(GL_BLEND_DST_ALPHA, &storedBlendDstAlpha);
     glGetIntegerv(GL_BLEND_DST_RGB,   &storedBlendDstRGB);
 
+    glGetIntegerv(GL_DEPTH_FUNC, &storedDepthFunc);
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &storedDepthMask);
+    storedDepthTest = glIsEnabled(GL_DEPTH_TEST);
+    storedBlend     = glIsEnabled(GL_BLEND);
+
     for (int i = 0; i < 9; i++) {
         glActiveTexture(GL_TEXTURE0 + i);
         glGetIntegerv(GL_TEXTURE_BINDING_2D, storedTextures + i);
@@ -718,6 +1342,11 @@ void restoreGLStates() {
         storedBlendDstAlpha
     );
 
+    glDepthFunc(storedDepthFunc);
+    glDepthMask(storedDepthMask);
+    if (storedDepthTest) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
+    if (storedBlend)     glEnable(GL_BLEND);      else glDisable(GL_BLEND);
+
     for (int i = 0; i < 9; i++) {
         glActiveTexture(GL_TEXTURE0 + i);
         glBindTexture(GL_TEXTURE_2D, storedTextures[i]);
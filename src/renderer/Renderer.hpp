@@ -12,42 +12,110 @@
 #include "DifferenceMode.hpp"
 #include "GroupManager.hpp"
 #include "ShaderSpriteManager.hpp"
+#include "ColorTable.hpp"
+#include "GPUTimer.hpp"
+#include "Metrics.hpp"
 #include "ObjectBatchNode.hpp"
 #include "../../resources/shaders/shared.h"
 
 using namespace geode;
 
+/*
+    The object shader is compiled in multiple variants.
+    A variant is a combination of these flags.
+
+    The feature flags keep the parts of the vertex shader
+    that only some objects need. Every batch records which
+    features its objects use, so most batches get a vertex
+    shader without any of them. Baked objects never use any.
+
+    With the resolve pass, the vertex shader reads the state of
+    its object from resolveObjects.comp instead of the SRB.
+    With vertex pulling, it builds its verticies from the
+    ObjectSprite buffer of the batch instead of attributes.
+    DRB_UNIFORM_BUFFER picks how the DRB is declared, see
+    DRB_UNIFORM_BUFFER_SIZE.
+*/
+#define OBJECT_SHADER_BAKED            (1 << 0)
+#define OBJECT_SHADER_OPAQUE_PASS      (1 << 1)
+#define OBJECT_SHADER_RESOLVED_OBJECTS (1 << 8)
+#define OBJECT_SHADER_VERTEX_PULLING   (1 << 9)
+#define OBJECT_SHADER_DRB_UNIFORM_BUFFER (1 << 10)
+
+#define OBJECT_SHADER_FEATURE_HSV             (1 << 2)
+#define OBJECT_SHADER_FEATURE_AUDIO_SCALE     (1 << 3)
+#define OBJECT_SHADER_FEATURE_INVISIBLE_BLOCK (1 << 4)
+#define OBJECT_SHADER_FEATURE_ROTATION        (1 << 5)
+#define OBJECT_SHADER_FEATURE_LOCAL_TRANSFORM (1 << 6)
+#define OBJECT_SHADER_FEATURE_SPECIAL_GLOW    (1 << 7)
+
+// The features that the resolve pass does once per object
+#define OBJECT_SHADER_RESOLVED_FEATURES ( \
+    OBJECT_SHADER_FEATURE_AUDIO_SCALE |   \
+    OBJECT_SHADER_FEATURE_ROTATION    |   \
+    OBJECT_SHADER_FEATURE_LOCAL_TRANSFORM \
+)
+
 class Renderer : public cocos2d::CCNode {
 private:
     inline Renderer()
-        : objectBatch(*this), groupManager(*this), differenceMode(*this),
-          shaderSpriteManager(*this), overdrawView(*this) {}
+        : groupManager(*this), differenceMode(*this),
+          shaderSpriteManager(*this), colorTable(*this),
+          overdrawView(*this) {}
     ~Renderer() override;
 
     bool init(PlayLayer* layer);
 
     void generateBatchNodes(ObjectSorter& sorter);
 
+    void findStaticOpaqueColorChannels();
+
+    void preprocessObjectShader(u32 variant);
+
+    void preprocessObjectShaders(ObjectBatch& batch);
+
+    bool compileObjectShaders();
+
+    bool finishObjectShaders(bool wait);
+
     void terminate();
 
     void prepareShaderUniforms();
 
     void prepareDynamicRenderingBuffer();
 
+    void bindDynamicRenderingBuffer();
+
+    u32 getShaderFeaturesOfObject(const StaticObjectInfo& objectInfo, GroupCombinationIndex groupCombIndex);
+
     void generateStaticRenderingBuffer(ObjectSorter& sorter);
 
+    bool prepareObjectResolvePass();
+
+    void resolveObjectsOnGPU();
+
+    bool prepareGPUCulling();
+
+    void cullChunksOnGPU();
+
     void draw() override;
 
+    void registerMetrics();
+
     void updateDebugText();
 
 protected:
     Shader* prepareDraw();
 
+    void beginOpaquePass();
+
+    void beginTranslucentPass();
+
     void finishDraw();
 
     inline GroupCombinationState* getGroupCombinationStates() {
-        if (drb == nullptr) return nullptr;
-        return drb->groupCombinationStates;
+        if (groupCombinationStates.empty()) return nullptr;
+        return groupCombinationStates.data();
     }
 
     friend class GroupManager;
@@ -56,7 +124,12 @@ protected:
 public:
     void update(float dt) override;
 
-    bool isObjectInView(usize srbIndex);
+    bool isChunkInView(const ObjectBatchChunk& chunk);
+
+    // A chunk is hidden when its group combination is toggled off or fully faded out
+    inline bool isChunkHidden(const ObjectBatchChunk& chunk) {
+        return groupCombinationStates[chunk.groupCombinationIndex].opacity < MIN_VISIBLE_OPACITY;
+    }
 
     inline cocos2d::CCTexture2D* getSpriteSheetTexture(SpriteSheet sheet) {
         if ((i32)sheet < 0 || (i32)sheet >= (i32)SpriteSheet::COUNT)
@@ -72,6 +145,37 @@ public:
         return objectSRBIndicies[object];
     }
 
+    inline GroupCombinationIndex getGroupCombinationIndex(usize srbIndex) {
+        return groupCombIndexPerObjectSRBIndex[srbIndex];
+    }
+
+    /*
+        A baked object has a static group combination and
+        nothing else about it changes. Its vertices are
+        written in world space and drawn with the baked shader.
+    */
+    inline bool isObjectBaked(usize srbIndex) {
+        return bakedPerObjectSRBIndex[srbIndex];
+    }
+
+    // The OBJECT_SHADER_FEATURE_* flags the object needs
+    inline u32 getObjectShaderFeatures(usize srbIndex) {
+        return shaderFeaturesPerObjectSRBIndex[srbIndex];
+    }
+
+    /*
+        Compiles the variant if it is not in the cache yet.
+        Returns nullptr if the variant failed to compile.
+    */
+    Shader* getObjectShader(u32 variant);
+
+    inline Shader* useObjectShader(u32 variant) {
+        auto shader = getObjectShader(variant);
+        if (shader)
+            shader->use();
+        return shader;
+    }
+
     inline bool isEnabled() { return enabled; }
 
     inline DifferenceMode* getDifferenceMode() {
@@ -84,6 +188,12 @@ public:
         debugTextEnabled = !debugTextEnabled;
     }
 
+    inline bool isDebugTextEnabled() const { return debugTextEnabled; }
+
+    inline GPUTimer& getGPUTimer() { return gpuTimer; }
+
+    inline Metrics& getMetrics() { return metrics; }
+
     inline bool isDifferenceModeEnabled() const { return differenceModeEnabled; }
     inline void setDifferenceModeEnabled(bool enabled) {
         differenceModeEnabled = enabled;
@@ -91,14 +201,35 @@ public:
 
     inline bool canEnableDisableIngame() const { return ingameEnableDisable; }
 
-    inline void setGJBGLUpdateTime(u64 time) {gjbglUpdateTime = time; }
-    inline void setTotalFrameTime(u64 time) { totalFrameTime = time; }
+    inline void setGJBGLUpdateTime(u64 time) { metrics.record(gjbglUpdateTimeMetric, time); }
+    inline void setTotalFrameTime(u64 time) { metrics.record(frameTimeMetric, time); }
+    inline void setGPUFrameTime(u64 time) { metrics.record(gpuTimeMetric, time); }
 
     inline bool isPaused() {
         return layer->m_isPaused;
     }
 
     inline bool isUseIndexCulling() const { return useIndexCulling; }
+    inline bool isUseGPUCulling() const { return useGPUCulling; }
+    inline bool isUseObjectResolvePass() const { return useObjectResolvePass; }
+    inline bool isUseVertexPulling() const { return useVertexPulling; }
+    inline bool isUseDrbUniformBuffer() const { return useDrbUniformBuffer; }
+    inline bool isUseDepthPass() const { return useDepthPass; }
+    inline bool isUseOcclusionTrimming() const { return useOcclusionTrimming; }
+    inline bool isUseSpriteMerging() const { return useSpriteMerging; }
+    inline bool isUseShaderSprites() const { return useShaderSprites; }
+
+    /*
+        A static opaque color channel is fully opaque and not
+        blending for the whole level. Only sprites with such a
+        color channel can occlude other sprites.
+    */
+    inline bool isColorChannelStaticOpaque(u32 channel) const {
+        return channel < staticOpaqueColorChannels.size() && staticOpaqueColorChannels[channel];
+    }
+
+    inline u32 getGPUChunkCount() const { return gpuChunkCount; }
+    inline u32 getGPUDrawListCount() const { return gpuDrawListCount; }
 
     bool useOptimizations();
 
@@ -106,6 +237,7 @@ public:
 
     inline GroupManager& getGroupManager() { return groupManager; }
     inline ShaderSpriteManager& getShaderSpriteManager() { return shaderSpriteManager; }
+    inline ColorTable& getColorTable() { return colorTable; }
 
     void reset();
 
@@ -128,22 +260,58 @@ private:
     bool ingameEnableDisable = false;
 
     bool useIndexCulling = false;
+    bool useGPUCulling = false;
+    bool useObjectResolvePass = false;
+    bool useVertexPulling = false;
+    bool useDrbUniformBuffer = false;
+    bool useDepthPass = false;
+    bool useOcclusionTrimming = false;
+    bool useSpriteMerging = false;
+    bool useShaderSprites = false;
 
     u64 rendererStartTime = 0;
 
-    u64 drbGenerationTime = 0;
-    u64 drawFuncTime = 0;
-    u64 gjbglUpdateTime = 0;
-    u64 totalFrameTime = 0;
-
-    usize spritesOnScreen = 0;
+    Metrics metrics;
+
+    MetricId frameTimeMetric;
+    MetricId gjbglUpdateTimeMetric;
+    MetricId drawTimeMetric;
+    MetricId batchNodeDrawTimeMetric;
+    MetricId drbGenerationTimeMetric;
+    MetricId gpuTimeMetric;
+    MetricId spritesOnScreenMetric;
+    MetricId batchNodeDrawsMetric;
+    MetricId vertexBufferSizeMetric;
+    MetricId srbSizeMetric;
+    MetricId drbSizeMetric;
+    MetricId objectShaderVariantsMetric;
+    MetricId colorTableEntriesMetric;
+    usize vertexBufferSize = 0;
+    usize chunkCount = 0;
+    // The amount of draw order steps of all batches, see ObjectBatch::getDepthOrderCount()
+    usize depthOrderCount = 0;
 
     std::unordered_map<GameObject*, usize> objectSRBIndicies;
 
-    // Used by the isObjectInView() function
     std::vector<GroupCombinationIndex> groupCombIndexPerObjectSRBIndex;
-    std::vector<glm::vec2> startPositionPerObjectSRBIndex;
-    glm::vec2 cameraCenterPos;
+
+    std::vector<bool> bakedPerObjectSRBIndex;
+    usize bakedObjectCount = 0;
+
+    std::vector<u8> shaderFeaturesPerObjectSRBIndex;
+
+    std::vector<bool> staticOpaqueColorChannels;
+
+    usize trimmedSpriteCount = 0;
+    usize removedSpriteCount = 0;
+    usize mergedSpriteCount = 0;
+    usize mergedQuadCount = 0;
+    usize writtenSpriteCount = 0;
+    usize shaderSpriteCount = 0;
+
+    // Used by the isChunkInView() function
+    glm::vec2 cameraViewMin;
+    glm::vec2 cameraViewMax;
 
     std::vector<ObjectBatchNode*> batchNodes;
 
@@ -160,28 +328,60 @@ private:
 
     ShaderSpriteManager shaderSpriteManager;
 
-    ObjectBatch objectBatch;
-    Shader* shader = nullptr;
+    ColorTable colorTable;
+
+    /*
+        The compiled object shader variants. Nothing in the object
+        shader depends on the level, so they are shared by every
+        renderer and only compiled once per session.
+    */
+    static inline std::map<u32, Shader*> objectShaders;
+
+    /*
+        Variants whose sources are preprocessed on worker threads
+        while the batches are generated, and variants the driver
+        may still be compiling until the first draw.
+    */
+    std::map<u32, std::future<std::optional<ShaderSources>>> preprocessingObjectShaders;
+    std::vector<u32> compilingObjectShaders;
     Shader* basicShader = nullptr;
 
-    DynamicRenderingBuffer* drb = nullptr;
+    // The colors of the color channels, resolved into the color table every frame
+    std::vector<RGBA> channelColors;
+    std::vector<bool> channelBlending;
+
+    // The group combination states and their packed form in the DRB
+    std::vector<GroupCombinationState> groupCombinationStates;
+    std::vector<u32> packedGroupStates;
     Buffer* drbBuffer = nullptr;
-    bool isDrbStorageBuffer;
 
     Buffer* srbBuffer = nullptr;
 
+    // Used for the object resolve pass
+    Shader* objectResolveShader = nullptr;
+    Buffer* resolvedObjectBuffer = nullptr;
+
+    // Used for GPU culling
+    Shader* chunkCullingShader = nullptr;
+    Buffer* chunkBuffer = nullptr;
+    Buffer* drawCommandBuffer = nullptr;
+    Buffer* drawCountBuffer = nullptr;
+    std::vector<u32> drawCountClearData;
+    u32 gpuChunkCount = 0;
+    u32 gpuDrawListCount = 0;
+
     RendererUniformBuffer uniforms;
     Buffer* uniformBuffer = nullptr;
 
     bool differenceModeEnabled = false;
     DifferenceMode differenceMode;
     OverdrawView overdrawView;
+    GPUTimer gpuTimer;
 
     float gameTimer = 0.0;
 
     i64 groupStateCount;
     i64 renderedGameObjectCount;
-    i64 renderTime;
 };
 
 void storeGLStates();
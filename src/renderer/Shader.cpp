@@ -1,19 +1,31 @@
 #include "Shader.hpp"
+#include "GLExtensions.hpp"
+#include "ProgramCache.hpp"
 #include "Geode/cocos/platform/win32/CCGL.h"
 #include "common.hpp"
-#include "glslang/MachineIndependent/Versions.h"
 
 #include <Geode/Geode.hpp>
 #include <vector>
 
+#ifdef BISMUTH_EMBEDDED_SHADERS
+#include <EmbeddedShaders.hpp>
+#else
+#include "glslang/MachineIndependent/Versions.h"
 #include <glslang/Public/ShaderLang.h>
 #include <SPIRV/GlslangToSpv.h>
+#endif
+
 #include <optional>
 #include <memory>
+#include <mutex>
 
 using namespace geode;
 
 Shader::~Shader() {
+    if (vertexShader)
+        glDeleteShader(vertexShader);
+    if (fragmentShader)
+        glDeleteShader(fragmentShader);
     if (program)
         glDeleteProgram(program);
 }
@@ -35,6 +47,28 @@ void printErrorLog(std::string str) {
         log::error("    {}", start);
 }
 
+static const char* getShaderTypeName(i32 type) {
+    switch (type) {
+    case GL_VERTEX_SHADER:   return "vertex";
+    case GL_FRAGMENT_SHADER: return "fragment";
+    case GL_COMPUTE_SHADER:  return "compute";
+    default:                 return "unknown";
+    }
+}
+
+/*
+    The shaders only use OpenGL 4.3 features, and Mesa llvmpipe,
+    which benchmarks/shaderCompile.cpp checks them on, only
+    supports GLSL up to 4.50.
+*/
+static constexpr i32 GLSL_VERSION = 450;
+
+static std::string getVersionDirective() {
+    return "#version " + std::to_string(GLSL_VERSION) + "\n";
+}
+
+#ifndef BISMUTH_EMBEDDED_SHADERS
+
 /*
     This is the main reason to use glslang. It is
     to use the #include pre-processor.
@@ -67,24 +101,57 @@ private:
 
 static TBuiltInResource getDefaultResources();
 
-static void removeLinesStartingWith(std::string& string, const std::string& start) {
-    usize index;
-    
-    while ((index = string.find("\n" + start)) != std::string::npos) {
-        index++;
-        usize afterIndex = index;
-        while (afterIndex < string.size() && string[afterIndex] != '\r' && string[afterIndex] != '\n')
-            afterIndex++;
-
-        std::string newCode = string.substr(0, index);
-        if (afterIndex < string.size())
-            newCode += string.substr(afterIndex, string.size() - afterIndex);
-        string = newCode;
+static const char* getShaderStageName(EShLanguage stage) {
+    switch (stage) {
+    case EShLangVertex:   return "vertex";
+    case EShLangFragment: return "fragment";
+    case EShLangCompute:  return "compute";
+    default:              return "unknown";
+    }
+}
+
+/*
+    Removes every line that starts with the given string. The
+    line breaks are kept so that the line numbers in the errors
+    of the driver stay the same.
+*/
+static void removeLinesStartingWith(std::string& string, std::string_view start) {
+    std::string result;
+    result.reserve(string.size());
+
+    usize lineStart = 0;
+    while (lineStart < string.size()) {
+        usize lineEnd = string.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+            lineEnd = string.size();
+
+        std::string_view line(string.data() + lineStart, lineEnd - lineStart);
+        if (!line.starts_with(start))
+            result += line;
+
+        if (lineEnd < string.size())
+            result += '\n';
+        lineStart = lineEnd + 1;
     }
+
+    string = std::move(result);
 }
 
+/*
+    Safe to call from any thread. keepLineDirectives is
+    passed in because glGetString only works on the thread
+    with the OpenGL context.
+*/
 // Confusingly, the enum for shader stages in glslang is called EShLanguage
-static std::optional<std::string> preprocessShader(EShLanguage stage, const std::string& code, const std::string& name) {
+static std::optional<std::string> preprocessShader(
+    EShLanguage stage,
+    const std::string& code,
+    const std::string& name,
+    bool keepLineDirectives
+) {
+    static std::once_flag glslangInitialized;
+    std::call_once(glslangInitialized, glslang::InitializeProcess);
+
     auto shader = std::make_unique<glslang::TShader>(stage);
 
     const char* str   = code.c_str();
@@ -92,10 +159,10 @@ static std::optional<std::string> preprocessShader(EShLanguage stage, const std:
     int length = code.size();
 
     shader->setStringsWithLengthsAndNames(&str, &length, &sname, 1);
-    shader->setEnvInput(glslang::EShSourceGlsl, stage, glslang::EShClientOpenGL, 450);
+    shader->setEnvInput(glslang::EShSourceGlsl, stage, glslang::EShClientOpenGL, GLSL_VERSION);
     shader->setEnvClient(glslang::EShClientOpenGL, glslang::EShTargetOpenGL_450);
     shader->setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_3);
-    shader->setOverrideVersion(450);
+    shader->setOverrideVersion(GLSL_VERSION);
     shader->setEntryPoint("main");
     shader->setAutoMapLocations(true);
     shader->setAutoMapBindings(true);
@@ -105,107 +172,268 @@ static std::optional<std::string> preprocessShader(EShLanguage stage, const std:
     auto res = getDefaultResources();
     std::string codeOut;
     if (!shader->preprocess(&res, 110, ENoProfile, false, false, EShMsgDefault, &codeOut, includer)) {
-        const char* shaderType = (stage == EShLangFragment) ? "fragment" : "vertex";
-        geode::log::error("failed to compile {} shader (glslang):", shaderType);
+        geode::log::error("failed to compile {} shader (glslang):", getShaderStageName(stage));
         printErrorLog(shader->getInfoLog());
         return std::nullopt;
     }
 
     removeLinesStartingWith(codeOut, "#extension GL_ARB_shading_language_include");
 
-    if (!isNVidiaGPU())
+    if (!keepLineDirectives)
         removeLinesStartingWith(codeOut, "#line");
 
-    return "#version 460\n" + codeOut;
+    return getVersionDirective() + codeOut;
 }
 
-static std::optional<ShaderSources> preprocessProgram(const fs::path& vertexPath, const fs::path& fragmentPath, std::string preCode) {
-    auto vertexSource   = readResourceFile(vertexPath);
-    auto fragmentSource = readResourceFile(fragmentPath);
+static EShLanguage getShaderStage(i32 type) {
+    switch (type) {
+    case GL_VERTEX_SHADER:   return EShLangVertex;
+    case GL_FRAGMENT_SHADER: return EShLangFragment;
+    default:                 return EShLangCompute;
+    }
+}
 
-    if (!vertexSource)
-        geode::log::error("could not find vertex shader at path: {}", vertexPath);
-    if (!fragmentSource)
-        geode::log::error("could not find fragment shader at path: {}", fragmentPath);
-    if (!vertexSource || !fragmentSource)
+static std::optional<std::string> loadShader(
+    i32 type,
+    const fs::path& path,
+    const std::string& preCode,
+    bool keepLineDirectives
+) {
+    auto source = readResourceFile(path);
+    if (!source) {
+        geode::log::error("could not find {} shader at path: {}", getShaderTypeName(type), path);
         return std::nullopt;
+    }
+
+    return preprocessShader(getShaderStage(type), preCode + source.value(), path.string(), keepLineDirectives);
+}
+
+#else
+
+/*
+    The includes of the embedded shaders are resolved at build
+    time by cmake/EmbedShaders.cmake. The macro variables are
+    left to the preprocessor of the driver.
+*/
+static std::optional<std::string> loadShader(
+    i32 type,
+    const fs::path& path,
+    const std::string& preCode,
+    bool keepLineDirectives
+) {
+    for (auto& shader : embeddedshaders::shaders) {
+        if (path.generic_string() == shader.name)
+            return getVersionDirective() + preCode + std::string(shader.source);
+    }
+
+    geode::log::error("could not find {} shader at path: {}", getShaderTypeName(type), path);
+    return std::nullopt;
+}
 
-    auto vertexShader = preprocessShader(EShLangVertex, preCode + vertexSource.value(), vertexPath.string());
+#endif
+
+static std::optional<ShaderSources> preprocessProgram(
+    const fs::path& vertexPath,
+    const fs::path& fragmentPath,
+    std::string preCode,
+    bool keepLineDirectives
+) {
+    auto vertexShader = loadShader(GL_VERTEX_SHADER, vertexPath, preCode, keepLineDirectives);
     if (!vertexShader) return std::nullopt;
 
-    auto fragmentShader = preprocessShader(EShLangFragment, preCode + fragmentSource.value(), fragmentPath.string());
+    auto fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentPath, preCode, keepLineDirectives);
     if (!fragmentShader) return std::nullopt;
 
     return ShaderSources { vertexShader.value(), fragmentShader.value() };
 }
 
-static u32 createShader(i32 type, const char* source) {
-    u32 shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, NULL);
-    glCompileShader(shader);
-
+static bool checkShaderCompileStatus(u32 shader, i32 type) {
     i32 success;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success) {
         char log[512];
         glGetShaderInfoLog(shader, 512, NULL, log);
-        const char* shaderType = (type == GL_FRAGMENT_SHADER) ? "fragment" : "vertex";
-        geode::log::error("failed to compile {} shader:", shaderType);
+        geode::log::error("failed to compile {} shader:", getShaderTypeName(type));
         printErrorLog(log);
-        return 0;
+        return false;
     };
 
+    return true;
+}
+
+static u32 startShaderCompile(i32 type, const char* source) {
+    u32 shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    return shader;
+}
+
+static u32 createShader(i32 type, const char* source) {
+    u32 shader = startShaderCompile(type, source);
+
+    if (!checkShaderCompileStatus(shader, type)) {
+        glDeleteShader(shader);
+        return 0;
+    }
+
     return shader;
 }
 
 Shader* Shader::create(const ShaderSources& sources) {
-    u32 vertexShader   = createShader(GL_VERTEX_SHADER, sources.vertexSource.c_str());
-    u32 fragmentShader = createShader(GL_FRAGMENT_SHADER, sources.fragmentSource.c_str());
+    Shader* shader = createAsync(sources);
 
-    if (!vertexShader || !fragmentShader) {
-        if (vertexShader)   glDeleteShader(vertexShader);
-        if (fragmentShader) glDeleteShader(fragmentShader);
+    if (!shader->finish()) {
+        destroy(shader);
         return nullptr;
     }
 
+    return shader;
+}
+
+Shader* Shader::createAsync(const ShaderSources& sources) {
+    Shader* shader = new Shader();
+
+    shader->cacheKey = programcache::getKey({ sources.vertexSource, sources.fragmentSource });
+    shader->program  = programcache::load(shader->cacheKey);
+    if (shader->program)
+        return shader;
+
+    // The compile status is only checked in finish(), so the driver doesn't have to stop here
+    shader->vertexShader   = startShaderCompile(GL_VERTEX_SHADER, sources.vertexSource.c_str());
+    shader->fragmentShader = startShaderCompile(GL_FRAGMENT_SHADER, sources.fragmentSource.c_str());
+
+    shader->program = glCreateProgram();
+    glAttachShader(shader->program, shader->vertexShader);
+    glAttachShader(shader->program, shader->fragmentShader);
+    programcache::prepareForSave(shader->program);
+    glLinkProgram(shader->program);
+
+    shader->pending = true;
+    return shader;
+}
+
+bool Shader::isReady() {
+    if (!pending || !glext::supportsParallelShaderCompile())
+        return true;
+
+    i32 completed = 0;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed;
+}
+
+bool Shader::finish() {
+    if (!pending)
+        return program != 0;
+    pending = false;
+
+    // Both are checked to log the errors of both
+    bool vertexCompiled   = checkShaderCompileStatus(vertexShader, GL_VERTEX_SHADER);
+    bool fragmentCompiled = checkShaderCompileStatus(fragmentShader, GL_FRAGMENT_SHADER);
+    bool success = vertexCompiled && fragmentCompiled;
+
+    if (success) {
+        i32 linked;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            char log[512];
+            glGetProgramInfoLog(program, 512, NULL, log);
+            geode::log::error("Failed to link shader program:");
+            printErrorLog(log);
+            success = false;
+        }
+    }
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    vertexShader   = 0;
+    fragmentShader = 0;
+
+    if (!success) {
+        glDeleteProgram(program);
+        program = 0;
+        return false;
+    }
+
+    programcache::save(cacheKey, program);
+    return true;
+}
+
+static std::string generatePreCode(const std::map<std::string, std::string>& macroVariables) {
+    std::string preCode = "#define GLSL\n";
+    for (auto [k, v] : macroVariables)
+        preCode += "#define " + k + " " + v + "\n";
+    return preCode;
+}
+
+Shader* Shader::create(
+    const fs::path& vertexPath,
+    const fs::path& fragmentPath,
+    std::map<std::string, std::string> macroVariables
+) {
+    auto sources = preprocessProgram(vertexPath, fragmentPath, generatePreCode(macroVariables), isNVidiaGPU());
+    if (!sources)
+        return nullptr;
+
+    return create(sources.value());
+}
+
+std::future<std::optional<ShaderSources>> Shader::preprocessAsync(
+    const fs::path& vertexPath,
+    const fs::path& fragmentPath,
+    std::map<std::string, std::string> macroVariables
+) {
+    bool keepLineDirectives = isNVidiaGPU();
+
+    return std::async(std::launch::async, [=]() {
+        return preprocessProgram(vertexPath, fragmentPath, generatePreCode(macroVariables), keepLineDirectives);
+    });
+}
+
+Shader* Shader::createComputeFromSource(const std::string& computeSource) {
+    auto cacheKey = programcache::getKey({ computeSource });
+    if (u32 program = programcache::load(cacheKey)) {
+        Shader* shader = new Shader();
+        shader->program = program;
+        return shader;
+    }
+
+    u32 computeShader = createShader(GL_COMPUTE_SHADER, computeSource.c_str());
+    if (!computeShader)
+        return nullptr;
+
     u32 program = glCreateProgram();
-    glAttachShader(program, vertexShader);
-    glAttachShader(program, fragmentShader);
+    glAttachShader(program, computeShader);
+    programcache::prepareForSave(program);
     glLinkProgram(program);
+    glDeleteShader(computeShader);
 
     int success;
     glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
         char log[512];
         glGetProgramInfoLog(program, 512, NULL, log);
-        geode::log::error("Failed to link shader program:");
+        geode::log::error("Failed to link compute shader program:");
         printErrorLog(log);
         glDeleteProgram(program);
         return nullptr;
     }
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    
+    programcache::save(cacheKey, program);
+
     Shader* shader = new Shader();
     shader->program = program;
     return shader;
 }
 
-Shader* Shader::create(
-    const fs::path& vertexPath,
-    const fs::path& fragmentPath,
+Shader* Shader::createCompute(
+    const fs::path& computePath,
     std::map<std::string, std::string> macroVariables
 ) {
-    std::string preCode = "#define GLSL\n";
-    for (auto [k, v] : macroVariables)
-        preCode += "#define " + k + " " + v + "\n";
-
-    auto sources = preprocessProgram(vertexPath, fragmentPath, preCode);
-    if (!sources)
+    auto computeShader = loadShader(GL_COMPUTE_SHADER, computePath, generatePreCode(macroVariables), isNVidiaGPU());
+    if (!computeShader)
         return nullptr;
 
-    return create(sources.value());
+    return createComputeFromSource(computeShader.value());
 }
 
 void Shader::setMatrix4(u32 location, const float* data) {
@@ -279,6 +507,8 @@ void Shader::setTextureArray(u32 location, i32 count, cocos2d::CCTexture2D** tex
     }
 }
 
+#ifndef BISMUTH_EMBEDDED_SHADERS
+
 // A bunch of bs required to compile with glslang, idk why
 static TBuiltInResource getDefaultResources() {
     TBuiltInResource resources;
@@ -387,4 +617,6 @@ static TBuiltInResource getDefaultResources() {
     resources.limits.generalConstantMatrixVectorIndexing  = 1;
 
     return resources;
-}
\ No newline at end of file
+}
+
+#endif
\ No newline at end of file
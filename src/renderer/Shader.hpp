@@ -4,6 +4,8 @@
 
 #include <string>
 #include <map>
+#include <future>
+#include <optional>
 
 struct ShaderSources {
     std::string vertexSource;
@@ -23,6 +25,29 @@ public:
         std::map<std::string, std::string> macroVariables = {}
     );
 
+    /*
+        Preprocesses the sources of a program on a worker thread.
+        Has to be called from the thread with the OpenGL context.
+    */
+    static std::future<std::optional<ShaderSources>> preprocessAsync(
+        const fs::path& vertexPath,
+        const fs::path& fragmentPath,
+        std::map<std::string, std::string> macroVariables = {}
+    );
+
+    /*
+        Starts compiling and linking the program without waiting
+        for the driver. Call finish() before using the shader.
+    */
+    static Shader* createAsync(const ShaderSources& sources);
+
+    static Shader* createComputeFromSource(const std::string& computeSource);
+
+    static Shader* createCompute(
+        const fs::path& computePath,
+        std::map<std::string, std::string> macroVariables = {}
+    );
+
     static inline void destroy(Shader* shader) {
         delete shader;
     }
@@ -31,6 +56,18 @@ public:
         glUseProgram(program);
     }
 
+    // Never blocks. Always true if the driver can't tell
+    bool isReady();
+
+    /*
+        Waits for the program of createAsync() and returns
+        whether it compiled and linked. Does nothing for a
+        shader that is already finished.
+    */
+    bool finish();
+
+    inline bool isFinished() const { return !pending; }
+
     inline u32 location(const char* name) {
         return glGetUniformLocation(program, name);
     }
@@ -86,4 +123,10 @@ public:
 
 private:
     u32 program = 0;
+
+    // Only set while the program of createAsync() is not finished
+    bool pending = false;
+    u32 vertexShader = 0;
+    u32 fragmentShader = 0;
+    u64 cacheKey = 0;
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "ShaderSpriteManager.hpp"
 #include "Geode/cocos/sprite_nodes/CCSpriteFrame.h"
+#include "UniformSpriteDictionary.hpp"
 
 using namespace geode::prelude;
 
@@ -42,50 +43,14 @@ u32 SpriteManager::addRectAsSpriteCrop(const CCRect& rect) {
 }
 */
 
-void ShaderSpriteManager::init() {
-    // registerShaderSprite("block005b_05_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("block009c_base_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("lightsquare_01_01_color_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("lightsquare_01_02_color_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("lightsquare_01_03_color_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("lightsquare_01_04_color_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("lightsquare_01_05_color_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("lightsquare_01_06_color_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("lightsquare_01_07_color_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("lightsquare_01_08_color_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("whiteSquare20_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("whiteSquare40_001.png", SHADER_SPRITE_SOLID_BLOCK);
-    // registerShaderSprite("whiteSquare60_001.png", SHADER_SPRITE_SOLID_BLOCK);
+ShaderSprite ShaderSpriteManager::getShaderSpriteOfSprite(cocos2d::CCSprite* sprite) {
+    auto color = UniformSpriteDictionary::getUniformColorForSprite(sprite);
+    if (color && color.value() == 0xffffffff)
+        return { SHADER_SPRITE_SOLID_BLOCK };
 
-    // registerShaderSprite("lighttriangle_01_02_color_001.png", SHADER_SPRITE_SOLID_SLOPE);
-    // registerShaderSprite("lighttriangle_01_04_color_001.png", SHADER_SPRITE_SOLID_SLOPE);
-}
-
-u32 ShaderSpriteManager::getShaderSpriteIndexOfSprite(cocos2d::CCSprite* sprite) {
-    CCRect       rect    = sprite->getTextureRect();
-    CCTexture2D* texture = sprite->getTexture();
-
-    CCDictionary* cachedFrames = CCSpriteFrameCache::sharedSpriteFrameCache()->m_pSpriteFrames;
-    CCSpriteFrame* frame = nullptr;
-
-    for (auto [key, value] : CCDictionaryExt<std::string, CCSpriteFrame*>(cachedFrames)) {
-        if (value->getTexture() == texture && value->getRect() == rect) {
-            frame = value;
-            break;
-        }
-    }
-
-    if (frame == nullptr)
-        return 0;
-
-    auto it = shaderSpriteIndexPerSpriteFrame.find(frame);
-    if (it == shaderSpriteIndexPerSpriteFrame.end())
-        return 0;
-    return it->second;
-}
+    auto slope = UniformSpriteDictionary::getUniformSlopeForSprite(sprite);
+    if (slope)
+        return { SHADER_SPRITE_SOLID_SLOPE, slope->flipX, slope->flipY };
 
-void ShaderSpriteManager::registerShaderSprite(const char* frameName, u32 shaderSpriteIndex) {
-    CCSpriteFrame* frame = CCSpriteFrameCache::sharedSpriteFrameCache()->spriteFrameByName(frameName);
-    if (frame == nullptr) return;
-    shaderSpriteIndexPerSpriteFrame[frame] = shaderSpriteIndex;
+    return {};
 }
\ No newline at end of file
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <common.hpp>
-#include <unordered_map>
 #include "../../resources/shaders/shared.h"
 /*
 #include "Buffer.hpp"
@@ -36,23 +35,30 @@ private:
 
 class Renderer;
 
+/*
+    The shader sprite of a sprite. For shader sprites, the
+    texture coordinates are the position in the sprite, which
+    can be flipped so the sprite matches the shader sprite.
+*/
+struct ShaderSprite {
+    u8   index = 0;
+    bool flipX = false;
+    bool flipY = false;
+};
+
+/*
+    Shader sprites are found automatically by looking at the
+    texels of the sprite frames (see UniformSpriteDictionary).
+    A fully white frame is a solid block and a frame that is
+    white on one side of its diagonal is a solid slope.
+*/
 class ShaderSpriteManager {
 public:
     inline ShaderSpriteManager(Renderer& renderer)
-        : renderer(renderer)
-    {
-        init();
-    }
-
-    void init();
+        : renderer(renderer) {}
 
-    u32 getShaderSpriteIndexOfSprite(cocos2d::CCSprite* sprite);
-
-private:
-    void registerShaderSprite(const char* frameName, u32 shaderSpriteIndex);
+    ShaderSprite getShaderSpriteOfSprite(cocos2d::CCSprite* sprite);
 
 private:
     Renderer& renderer;
-
-    std::unordered_map<cocos2d::CCSpriteFrame*, u32> shaderSpriteIndexPerSpriteFrame;
 };
\ No newline at end of file
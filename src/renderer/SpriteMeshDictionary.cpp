@@ -7,6 +7,10 @@
 #include <optional>
 #include <unordered_map>
 
+#ifdef BISMUTH_EMBEDDED_OPAQUE_MESHES
+#include <EmbeddedOpaqueMeshes.hpp>
+#endif
+
 using namespace geode::prelude;
 
 static std::unordered_map<CCSprite*, CCSpriteFrame*> spriteFramesOfSprites;
@@ -26,22 +30,44 @@ class $modify(SpriteMeshDictionaryCCSprite, CCSprite) {
     }
 };
 
-static std::unordered_map<CCSpriteFrame*, ConvexList> spriteMeshesPerFrame;
+using MeshesPerFrame = std::unordered_map<CCSpriteFrame*, ConvexList>;
 
-ConvexList* SpriteMeshDictionary::getSpriteMeshForSprite(cocos2d::CCSprite* sprite) {
-    auto frameIt = spriteFramesOfSprites.find(sprite);
-    if (frameIt == spriteFramesOfSprites.end())
+static MeshesPerFrame spriteMeshesPerFrame;
+static MeshesPerFrame opaqueMeshesPerFrame;
+
+cocos2d::CCSpriteFrame* SpriteMeshDictionary::getSpriteFrameOfSprite(cocos2d::CCSprite* sprite) {
+    auto it = spriteFramesOfSprites.find(sprite);
+    if (it == spriteFramesOfSprites.end())
         return nullptr;
+    return it->second;
+}
 
-    auto meshIt = spriteMeshesPerFrame.find(frameIt->second);
-    if (meshIt == spriteMeshesPerFrame.end())
+static ConvexList* getMeshForSprite(MeshesPerFrame& meshes, cocos2d::CCSprite* sprite) {
+    auto frame = SpriteMeshDictionary::getSpriteFrameOfSprite(sprite);
+    if (!frame)
+        return nullptr;
+
+    auto meshIt = meshes.find(frame);
+    if (meshIt == meshes.end())
         return nullptr;
 
     return &meshIt->second;
 }
 
+ConvexList* SpriteMeshDictionary::getSpriteMeshForSprite(cocos2d::CCSprite* sprite) {
+    return getMeshForSprite(spriteMeshesPerFrame, sprite);
+}
+
+ConvexList* SpriteMeshDictionary::getOpaqueMeshForSprite(cocos2d::CCSprite* sprite) {
+    return getMeshForSprite(opaqueMeshesPerFrame, sprite);
+}
+
 static std::optional<ConvexList> parseConvexList(const matjson::Value& array);
 
+static void loadMeshesFromFile(MeshesPerFrame& meshes, const fs::path& path);
+
+static void loadMeshesFromSource(MeshesPerFrame& meshes, const std::string& source);
+
 static fs::path lastLoadedFilePath = "";
 
 void SpriteMeshDictionary::loadFromFile(const fs::path& path) {
@@ -49,13 +75,36 @@ void SpriteMeshDictionary::loadFromFile(const fs::path& path) {
         return;
     lastLoadedFilePath = path;
 
-    spriteMeshesPerFrame.clear();
+    loadMeshesFromFile(spriteMeshesPerFrame, path);
+}
+
+void SpriteMeshDictionary::loadOpaqueMeshes() {
+#ifdef BISMUTH_EMBEDDED_OPAQUE_MESHES
+    static bool opaqueMeshesLoaded = false;
+    if (opaqueMeshesLoaded)
+        return;
+    opaqueMeshesLoaded = true;
+
+    loadMeshesFromSource(opaqueMeshesPerFrame, std::string(embeddedfiles::spriteOpaqueMeshes));
+#endif
+}
+
+usize SpriteMeshDictionary::getOpaqueMeshCount() {
+    return opaqueMeshesPerFrame.size();
+}
+
+static void loadMeshesFromFile(MeshesPerFrame& meshes, const fs::path& path) {
+    meshes.clear();
 
     auto source = readResourceFile(path);
     if (!source.has_value())
         return;
 
-    auto result = matjson::parse(source.value());
+    loadMeshesFromSource(meshes, source.value());
+}
+
+static void loadMeshesFromSource(MeshesPerFrame& meshes, const std::string& source) {
+    auto result = matjson::parse(source);
     if (!result.isOk())
         return;
 
@@ -77,7 +126,7 @@ void SpriteMeshDictionary::loadFromFile(const fs::path& path) {
         if (!convexList.has_value())
             continue;
 
-        spriteMeshesPerFrame[frame] = convexList.value();
+        meshes[frame] = convexList.value();
     }
 }
 
@@ -128,18 +177,5 @@ static std::optional<ConvexPolygon> parseConvexPolygon(const matjson::Value& arr
         });
     }
 
-    ConvexPolygon polygon;
-
-    for (isize i = 0; i < points.size(); i++) {
-        isize nextI = i + 1;
-        if (nextI >= points.size()) nextI = 0;
-
-        glm::vec2 p1 = points[i];
-        glm::vec2 p2 = points[nextI];
-
-        auto line = Line { p1, getClockwise(p2 - p1) };
-        polygon.addLine(line);
-    }
-
-    return polygon;
+    return ConvexPolygon::fromPoints(points);
 }
\ No newline at end of file
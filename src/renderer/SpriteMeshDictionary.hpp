@@ -5,7 +5,23 @@
 
 class SpriteMeshDictionary {
 public:
+    // Returns the frame the sprite was created with, or nullptr
+    static cocos2d::CCSpriteFrame* getSpriteFrameOfSprite(cocos2d::CCSprite* sprite);
+
     static ConvexList* getSpriteMeshForSprite(cocos2d::CCSprite* sprite);
 
+    /*
+        The opaque mesh of a sprite only covers texels with an
+        alpha of 255. These are generated by the script
+        codegenSpriteOpaqueMeshes.js when building with
+        BISMUTH_GD_RESOURCES, and embedded into the mod.
+    */
+    static ConvexList* getOpaqueMeshForSprite(cocos2d::CCSprite* sprite);
+
     static void loadFromFile(const fs::path& path);
+
+    // Does nothing if the mod was built without opaque meshes
+    static void loadOpaqueMeshes();
+
+    static usize getOpaqueMeshCount();
 };
\ No newline at end of file
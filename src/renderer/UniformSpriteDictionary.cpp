@@ -0,0 +1,181 @@
+#include "UniformSpriteDictionary.hpp"
+#include "Geode/cocos/sprite_nodes/CCSpriteFrame.h"
+#include "Geode/cocos/sprite_nodes/CCSpriteFrameCache.h"
+#include "SpriteMeshDictionary.hpp"
+#include "common.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace geode::prelude;
+
+static std::unordered_set<CCTexture2D*> scannedSpriteSheets;
+static std::unordered_map<CCSpriteFrame*, u32> uniformColorPerFrame;
+static std::unordered_map<CCSpriteFrame*, UniformSlope> uniformSlopePerFrame;
+
+#define TEXEL_WHITE 0xffffffff
+
+// Smaller frames are too blurry to tell if they are a slope
+#define MIN_SLOPE_FRAME_SIZE 4.0f
+
+static std::optional<u32> getUniformColorOfTexels(const std::vector<u32>& texels, i32 textureWidth, i32 textureHeight, const CCRect& rect) {
+    // Only texels fully inside of the rect are checked
+    i32 minX = std::max((i32)std::ceil(rect.getMinX()), 0);
+    i32 minY = std::max((i32)std::ceil(rect.getMinY()), 0);
+    i32 maxX = std::min((i32)std::floor(rect.getMaxX()), textureWidth);
+    i32 maxY = std::min((i32)std::floor(rect.getMaxY()), textureHeight);
+
+    if (minX >= maxX || minY >= maxY)
+        return std::nullopt;
+
+    u32 color = texels[minY * textureWidth + minX];
+
+    // The alpha is in the highest byte
+    if ((color >> 24) != 0xff)
+        return std::nullopt;
+
+    for (i32 y = minY; y < maxY; y++) {
+        for (i32 x = minX; x < maxX; x++) {
+            if (texels[y * textureWidth + x] != color)
+                return std::nullopt;
+        }
+    }
+
+    return color;
+}
+
+static std::optional<UniformSlope> getUniformSlopeOfTexels(const std::vector<u32>& texels, i32 textureWidth, i32 textureHeight, CCSpriteFrame* frame) {
+    CCRect rect = frame->getRectInPixels();
+    bool rotated = frame->isRotated();
+
+    float width  = rect.size.width;
+    float height = rect.size.height;
+    if (width < MIN_SLOPE_FRAME_SIZE || height < MIN_SLOPE_FRAME_SIZE)
+        return std::nullopt;
+
+    glm::vec2 origin = ccPointToGLM(rect.origin);
+    glm::vec2 size   = rotated ? glm::vec2(height, width) : glm::vec2(width, height);
+
+    i32 minX = std::max((i32)std::ceil(origin.x), 0);
+    i32 minY = std::max((i32)std::ceil(origin.y), 0);
+    i32 maxX = std::min((i32)std::floor(origin.x + size.x), textureWidth);
+    i32 maxY = std::min((i32)std::floor(origin.y + size.y), textureHeight);
+
+    // Texels this close to the diagonal can be partly covered by it
+    float margin = 1.0f / width + 1.0f / height;
+
+    // Bottom right, bottom left, top left and top right
+    bool isPossible[4] = { true, true, true, true };
+
+    for (i32 y = minY; y < maxY; y++) {
+        for (i32 x = minX; x < maxX; x++) {
+            glm::vec2 texel = glm::vec2(x + 0.5f, y + 0.5f) - origin;
+
+            // The position in the frame, (0, 0) being the bottom left
+            float u, v;
+            if (!rotated) {
+                u = texel.x / width;
+                v = 1.0f - texel.y / height;
+            } else {
+                u = texel.y / width;
+                v = texel.x / height;
+            }
+
+            u32 color = texels[y * textureWidth + x];
+            bool isWhite = color == TEXEL_WHITE;
+            bool isClear = (color >> 24) == 0;
+
+            // This is positive inside of the white half
+            float distances[4] = { u - v, 1.0f - u - v, v - u, u + v - 1.0f };
+
+            bool isAnyPossible = false;
+            for (i32 i = 0; i < 4; i++) {
+                if (distances[i] > margin && !isWhite)
+                    isPossible[i] = false;
+                if (distances[i] < -margin && !isClear)
+                    isPossible[i] = false;
+                isAnyPossible |= isPossible[i];
+            }
+
+            if (!isAnyPossible)
+                return std::nullopt;
+        }
+    }
+
+    if (isPossible[0]) return UniformSlope { false, false };
+    if (isPossible[1]) return UniformSlope { true,  false };
+    if (isPossible[2]) return UniformSlope { true,  true  };
+    if (isPossible[3]) return UniformSlope { false, true  };
+    return std::nullopt;
+}
+
+void UniformSpriteDictionary::scanSpriteSheet(CCTexture2D* texture) {
+    if (!texture || scannedSpriteSheets.contains(texture))
+        return;
+    scannedSpriteSheets.insert(texture);
+
+    i32 width  = texture->getPixelsWide();
+    i32 height = texture->getPixelsHigh();
+
+    std::vector<u32> texels(width * height);
+
+    ccGLBindTexture2D(texture->getName());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+
+    usize uniformFrameCount = 0;
+    usize uniformSlopeCount = 0;
+
+    auto frames = CCSpriteFrameCache::get()->m_pSpriteFrames;
+    for (auto [name, frame] : CCDictionaryExt<std::string, CCSpriteFrame*>(frames)) {
+        if (frame->getTexture() != texture)
+            continue;
+
+        CCRect rect = frame->getRectInPixels();
+
+        // The width and height of a rotated frame are swapped on the texture
+        if (frame->isRotated())
+            std::swap(rect.size.width, rect.size.height);
+
+        auto color = getUniformColorOfTexels(texels, width, height, rect);
+        if (color) {
+            uniformColorPerFrame[frame] = color.value();
+            uniformFrameCount++;
+            continue;
+        }
+
+        auto slope = getUniformSlopeOfTexels(texels, width, height, frame);
+        if (slope) {
+            uniformSlopePerFrame[frame] = slope.value();
+            uniformSlopeCount++;
+        }
+    }
+
+    log::info(
+        "Found {} uniform sprite frame(s) and {} uniform slope(s) on texture {}",
+        uniformFrameCount, uniformSlopeCount, texture->getName()
+    );
+}
+
+std::optional<u32> UniformSpriteDictionary::getUniformColorForSprite(cocos2d::CCSprite* sprite) {
+    auto frame = SpriteMeshDictionary::getSpriteFrameOfSprite(sprite);
+    if (!frame)
+        return std::nullopt;
+
+    auto it = uniformColorPerFrame.find(frame);
+    if (it == uniformColorPerFrame.end())
+        return std::nullopt;
+
+    return it->second;
+}
+
+std::optional<UniformSlope> UniformSpriteDictionary::getUniformSlopeForSprite(cocos2d::CCSprite* sprite) {
+    auto frame = SpriteMeshDictionary::getSpriteFrameOfSprite(sprite);
+    if (!frame)
+        return std::nullopt;
+
+    auto it = uniformSlopePerFrame.find(frame);
+    if (it == uniformSlopePerFrame.end())
+        return std::nullopt;
+
+    return it->second;
+}
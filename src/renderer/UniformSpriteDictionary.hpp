@@ -0,0 +1,33 @@
+#pragma once
+
+#include <common.hpp>
+#include <optional>
+
+/*
+    A uniform slope frame is split in two by a diagonal. One
+    half is fully white and opaque, the other is fully clear.
+    By default, the bottom right half is the white one. The
+    flips tell which half it is when it is not.
+*/
+struct UniformSlope {
+    bool flipX;
+    bool flipY;
+};
+
+/*
+    A uniform sprite frame has the exact same color and an
+    alpha of 255 in every texel. Drawing any part of such a
+    frame looks the same as sampling a single texel of it.
+
+    These are found by reading back the sprite sheet textures
+    and scanning the texels of every frame on them.
+*/
+class UniformSpriteDictionary {
+public:
+    static void scanSpriteSheet(cocos2d::CCTexture2D* texture);
+
+    // Returns the color of the frame of the sprite as RGBA, if it is uniform
+    static std::optional<u32> getUniformColorForSprite(cocos2d::CCSprite* sprite);
+
+    static std::optional<UniformSlope> getUniformSlopeForSprite(cocos2d::CCSprite* sprite);
+};
@@ -221,8 +221,15 @@ class $modify(RendererCCDisplayLinkDirector, CCDisplayLinkDirector) {
             return;
         }
 
+        // The GPU timer only measures while the debug text is shown or the metrics are streamed
+        auto& gpuTimer = ren->getGPUTimer();
+        gpuTimer.beginFrame(ren->isDebugTextEnabled() || ren->getMetrics().isSinkOpen());
+        if (gpuTimer.hasNewResults())
+            ren->setGPUFrameTime(gpuTimer.getTotalTime());
+
         u64 prevTime = getTime();
         CCDisplayLinkDirector::mainLoop();
         ren->setTotalFrameTime(getTime() - prevTime);
+        ren->getMetrics().endFrame();
     }
 };
\ No newline at end of file